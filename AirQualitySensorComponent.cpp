@@ -1,175 +1,218 @@
 #include "AirQualitySensorComponent.h"
 
-#include <Adafruit_CCS811.h>
-
 #include "Device.h"
+#include "FlightRecorder.h"
+#include "Metrics.h"
 
 #define CCS811_ECO2_MAX 8191 // stolen from elsewhere
 #define CCS811_TVOC_MAX 1187 // stolen from elsewhere
 
-extern Device Device;
+// ALG_RESULT_DATA holds eCO2(2) TVOC(2) STATUS ERROR_ID RAW_DATA(2), so
+// one burst read from there gets the status with the data.
+static constexpr uint8_t CCS811_REG_ALG_RESULT_DATA = 0x02;
+static constexpr uint8_t CCS811_REG_BASELINE = 0x11;
+static constexpr uint8_t CCS811_STATUS_ERROR = 0x01;
+static constexpr uint8_t CCS811_STATUS_DATA_READY = 0x08;
 
-AirQualitySensorComponent::AirQualitySensorComponent(TwoWire* theWire, BinToggle& reset) :
-     m_ccs811(new Adafruit_CCS811),
-     m_wire(theWire),
-     m_reset(reset)
+extern Device Device;
+extern FlightRecorder FlightRecorder;
+extern Metrics Metrics;
+
+AirQualitySensorComponent::AirQualitySensorComponent(
+        I2CBus& bus, int8_t pin_reset, int8_t pin_nint) :
+     m_epoch(UINT32_MAX),
+     m_state(STATE_NONE),
+     m_bus(bus),
+     // The CCS811 does 400kHz, but it stretches the clock a lot while it
+     // is busy. Stay at 100kHz and allow for long stretches.
+     m_i2cdev(F("ccs811"), CCS811_ADDRESS, 100000, 500),
+     m_pin_reset(pin_reset),
+     m_pin_nint(pin_nint),
+     m_baseline(0),
+     m_samples(0)
 {
-    m_reset.toggle(false); // disable/down reset pin
+    // Out of reset as soon as we can: an output, HIGH.
+    if (m_pin_reset >= 0) {
+        pinMode(m_pin_reset, OUTPUT);
+    }
+    reset(false);
 }
 
 void AirQualitySensorComponent::setup()
 {
+    if (m_pin_nint >= 0) {
+        pinMode(m_pin_nint, INPUT_PULLUP);
+    }
     Device.set_alert(Device::INACTIVE_CCS811);
 }
 
 void AirQualitySensorComponent::loop()
 {
-    enum state new_state = STATE_NONE;
-
-    switch (m_state) {
-        case STATE_NONE:
-            // Force reset, we _must_ call begin() after this.
-            m_reset.toggle(true);
-            new_state = STATE_RESETTING;
-            break;
-        case STATE_RESETTING:
-            // Reset/wake pulses must be at least 20us, so 1ms is enough.
-            if ((millis() - m_lastact) <= 1) {
-                return;
-            }
-            m_reset.toggle(false);
-            new_state = STATE_WAKING;
-            break;
-        case STATE_WAKING:
-            // At 20ms after boot/reset are we up again.
-            if ((millis() - m_lastact) <= 20) {
-                return;
-            }
-            if (m_ccs811->begin(CCS811_ADDRESS, m_wire)) {
-                new_state = STATE_ACTIVE;
-                dump_info();
-                sample();
-            } else {
-                Serial << F("AirQualitySensorComponent: CCS811: ") <<  // (idefix)
-                    F("communication failure\r\n");
-                Device.set_alert(Device::INACTIVE_CCS811);
-                new_state = STATE_FAILING;
-            }
-            break;
-        case STATE_ACTIVE:
-            // Sample every m_interval seconds, normally.
-            if ((millis() - m_lastact) < m_interval) {
-                return;
-            }
-            new_state = STATE_ACTIVE;  // keep same state
-            sample();
-            break;
-        case STATE_FAILING:
-            // Wait a while if we failed to start.
-            if ((millis() - m_lastact) < m_interval) {
-                return;
+    if (!m_co.is_due()) {
+        return;
+    }
+    CO_BEGIN(m_co);
+    for (;;) {
+        // Force reset, we _must_ call begin() after this.
+        set_state(STATE_RESETTING);
+        reset(true);
+        // Reset/wake pulses must be at least 20us, so 1ms is enough;
+        // that is 2 ticks of millis().
+        CO_AWAIT_MS(m_co, 2);
+        reset(false);
+        set_state(STATE_WAKING);
+        // At 20ms after boot/reset are we up again.
+        CO_AWAIT_MS(m_co, 21);
+
+        if (begin()) {
+            // Sample once per epoch, with the other sensors. With nINT
+            // wired, wait for it as well, so we never wake it up for
+            // nothing.
+            for (;;) {
+                CO_AWAIT(m_co, m_state != STATE_ACTIVE || (
+                    Device.get_epoch() != m_epoch &&
+                    (m_pin_nint < 0 || digitalRead(m_pin_nint) == LOW)));
+                if (m_state != STATE_ACTIVE) {
+                    break;  // sample() saw a sensor error
+                }
+                m_epoch = Device.get_epoch();
+                // Sensor reads go before any pending display updates.
+                CO_AWAIT_I2C(m_co, m_bus, m_i2cdev, &sample_job, this, I2CBus::PRIO_HIGH);
             }
-            new_state = STATE_NONE;
-            break;
+        }
+        // Wait a while if we failed to start.
+        CO_AWAIT_MS(m_co, m_interval);
+    }
+    CO_END(m_co);
+}
+
+bool AirQualitySensorComponent::begin()
+{
+    m_bus.acquire(m_i2cdev);
+    if (!m_ccs811.begin(CCS811_ADDRESS, m_bus.get_wire())) {
+        m_bus.release();
+        LOG_WARN(AIRQUALITY) << F("AirQualitySensorComponent: CCS811: ") <<  // (idefix)
+            F("communication failure\r\n");
+        Device.set_alert(Device::INACTIVE_CCS811);
+        set_state(STATE_FAILING);
+        return false;
+    }
+    set_state(STATE_ACTIVE);
+    if (m_pin_nint >= 0) {
+        m_ccs811.enableInterrupt();  // nINT low on new data
+    }
+    dump_info();
+    m_samples = BASELINE_SAMPLES;  // read it with the first sample
+    m_epoch = Device.get_epoch();
+    sample();
+    m_bus.release();
+    return true;
+}
+
+void AirQualitySensorComponent::set_state(enum state new_state)
+{
+    if (new_state == m_state) {
+        return;
     }
-#ifdef DEBUG
-    Serial << F("  --AirQualitySensorComponent: state ") <<  // (idefix)
+    FlightRecorder.record(FlightRecorder::EV_CCS811_STATE, m_state, new_state);
+    Metrics.count(Metrics::CCS811_CHANGES);
+    Metrics.set(Metrics::CCS811_STATE, new_state);
+    LOG_DEBUG(AIRQUALITY) << F("  --AirQualitySensorComponent: state ") <<  // (idefix)
         m_state << F(" -> ") << new_state << F("\r\n");
-#endif
     m_state = new_state;
-    m_lastact = millis();
 }
 
 void AirQualitySensorComponent::dump_info()
 {
     // Print CCS811 sensor information
-    // FIXME: improved Serial << usage
     // FIXME: the Adafruit_CCS811 lib does not show these:
     // 17:06:20.786915: Hardware ID:           0x81
     // 17:06:20.786936: Hardware Version:      0x12
     // 17:06:20.786962: Firmware Boot Version: 0x1000
     // 17:06:20.786990: Firmware App Version:  0x2000
     //
-    Serial << F("AirQualitySensorComponent: CCS811: ") << F("enabled\r\n");
+    LOG_INFO(AIRQUALITY) << F("AirQualitySensorComponent: CCS811: ") << F("enabled\r\n");
 #if 0
-    Serial.print(F("Hardware ID:           0x"));
-    Serial.println(m_ccs811->getHWID(), HEX);
-    Serial.print(F("Hardware Version:      0x"));
-    Serial.println(m_ccs811->getHWVersion(), HEX);
-    Serial.print(F("Firmware Boot Version: 0x"));
-    Serial.println(m_ccs811->getFWBootVersion(), HEX);
-    Serial.print(F("Firmware App Version:  0x"));
-    Serial.println(m_ccs811->getFWAppVersion(), HEX);
-    Serial.println();
+    LOG_DEBUG(AIRQUALITY) <<  // (idefix)
+        F("Hardware ID:           0x") << LogHex(m_ccs811.getHWID()) << F("\r\n") <<
+        F("Hardware Version:      0x") << LogHex(m_ccs811.getHWVersion()) << F("\r\n") <<
+        F("Firmware Boot Version: 0x") << LogHex(m_ccs811.getFWBootVersion()) << F("\r\n") <<
+        F("Firmware App Version:  0x") << LogHex(m_ccs811.getFWAppVersion()) << F("\r\n");
 #endif
 }
 
 void AirQualitySensorComponent::sample()
 {
     // FIXME: use SimpleKalmanFilter here (and for DHT11)
-    uint16_t ccs_eco2;  // CCS811 eCO2
-    uint16_t ccs_tvoc;  // CCS811 TVOC
-
-    // Read the sensor data, this updates multiple fields
-    // in the CCS811 library
-    if (!m_ccs811->available()) {
-        if (m_ccs811->checkError()) {
-            Serial << F("ERROR: CCS811 ERROR flag set\r\n");
-            // FIXME: print/show/decode errors..
-            Device.set_alert(Device::INACTIVE_CCS811);
-            m_state = STATE_FAILING;
-        } else {
-            Serial << F("CCS811: Data not ready\r\n");
-        }
+    uint8_t buf[8];
+
+    // One transaction: the data, and the status and error that go with
+    // it. Reading it clears DATA_READY (and releases nINT). A captured
+    // one, with the bring-up before it, is in
+    // local_bogoduino/replay/ccs811.trace ("make replay-test").
+    if (!m_bus.read(m_i2cdev, CCS811_REG_ALG_RESULT_DATA, buf, sizeof(buf))) {
+        LOG_WARN(AIRQUALITY) << F("AirQualitySensorComponent: CCS811: ") <<  // (idefix)
+            F("read failed\r\n");
+        return;
+    }
+    uint8_t status = buf[4];
+    if (status & CCS811_STATUS_ERROR) {
+        // 0x01 WRITE_REG_INVALID, 0x02 READ_REG_INVALID, 0x04
+        // MEASMODE_INVALID, 0x08 MAX_RESISTANCE, 0x10 HEATER_FAULT,
+        // 0x20 HEATER_SUPPLY
+        LOG_ERROR(AIRQUALITY) << F("ERROR: CCS811 ERROR flag set, error_id 0x") <<  // (idefix)
+            LogHex(buf[5]) << F("\r\n");
+        Device.set_alert(Device::INACTIVE_CCS811);
+        set_state(STATE_FAILING);
+        return;
+    }
+    if (!(status & CCS811_STATUS_DATA_READY)) {
+        LOG_INFO(AIRQUALITY) << F("CCS811: Data not ready\r\n");
         return;
     }
 
-    uint8_t error_id = m_ccs811->readData(); // 0x4 == MEASMODE_INVALID
-    // WARNING: Do not call available() _after_ readData(). That would
-    // cause the following sequence of messages:
-    // 19:37:32.905514: I2CWRITE @ 0x5A :: 0x0,  <-- read status
-    // 19:37:32.905591: I2CREAD  @ 0x5A :: 0x98,
-    // 19:37:32.905616: I2CWRITE @ 0x5A :: 0x2,  <-- get data
-    // 19:37:32.905642: I2CREAD  @ 0x5A :: 0x5, 0x91, 0x0, 0x9C, 0x98, 0x4, 0xD, 0x7E,
-    // 19:37:32.905691: I2CWRITE @ 0x5A :: 0x0,  <-- read status
-    // 19:37:32.905719: I2CREAD  @ 0x5A :: 0x90,
-    // That available() returns 0x90, which means (READY_FOR_WORK, but no data):
-    // - 0x01 = ERROR
-    // - 0x06 = reserved
-    // - 0x08 = NEW_DATA
-    // - 0x10 = APP_VALID
-    // - 0x60 = reserved
-    // - 0x80 = READY_FOR_WORK
-    (void)error_id; // ignore for now
+    if (++m_samples >= BASELINE_SAMPLES) {
+        uint8_t baseline[2];
+        if (m_bus.read(m_i2cdev, CCS811_REG_BASELINE, baseline, sizeof(baseline))) {
+            m_baseline = baseline[0] << 8 | baseline[1];  // opaque
+            m_samples = 0;
+        }
+    }
 
     bool good_data = true;
 
-    // Data is ready
-    ccs_eco2 = m_ccs811->geteCO2();
-    ccs_tvoc = m_ccs811->getTVOC();
+    uint16_t ccs_eco2 = buf[0] << 8 | buf[1];  // CCS811 eCO2
+    uint16_t ccs_tvoc = buf[2] << 8 | buf[3];  // CCS811 TVOC
 
     if (ccs_eco2 > 4000) {
-        Serial << F("AirQualitySensorComponent: CCS811: ") <<  // (idefix)
+        LOG_WARN(AIRQUALITY) << F("AirQualitySensorComponent: CCS811: ") <<  // (idefix)
             F("eCO2 exceeded limit\r\n");
         good_data = false;
     }
     if (ccs_tvoc > 1500) {
-        Serial << F("AirQualitySensorComponent: CCS811: ") <<  // (idefix)
+        LOG_WARN(AIRQUALITY) << F("AirQualitySensorComponent: CCS811: ") <<  // (idefix)
             F("TVOC exceeded limit\r\n");
         good_data = false;
     }
 
-    Serial << F("AirQualitySensorComponent: ") <<  // (idefix)
+    LOG_INFO(AIRQUALITY) << F("AirQualitySensorComponent: ") <<  // (idefix)
         ccs_eco2 << F(" ppm(eCO2),  ") <<  // (idefix)
-        ccs_tvoc << F(" ppb(TVOC), ");
-    Serial.print(m_ccs811->getBaseline(), HEX);
-    Serial << F(" opaque baseline\r\n");
+        ccs_tvoc << F(" ppb(TVOC), ") <<  // (idefix)
+        LogHex(m_baseline) << F(" opaque baseline\r\n");
 
     // Publish values
     if (good_data) {
         Device.clear_alert(Device::INACTIVE_CCS811);
-        Device.publish("pe32/hud/co2/xwwwform", (
-            String("eco2=") + ccs_eco2 + String("&tvoc=") + ccs_tvoc +
-            String("&baseline=") + m_ccs811->getBaseline()));
+        Device.set_reading(Device::READING_ECO2, ccs_eco2);
+        Device.set_reading(Device::READING_TVOC, ccs_tvoc);
+        String formdata;
+        formdata.reserve(40);
+        formdata += F("eco2=");
+        formdata += ccs_eco2;
+        formdata += F("&tvoc=");
+        formdata += ccs_tvoc;
+        formdata += F("&baseline=");
+        formdata += m_baseline;
+        Device.telemetry(Device::SENSOR_CCS811, m_epoch, F("pe32/hud/co2/xwwwform"), formdata);
     }
 }
@@ -3,12 +3,22 @@
 
 #include "pe32hud.h"
 
-class Adafruit_CCS811;
+#include "Coroutine.h"
+#include "I2CBus.h"
+
+#include <Adafruit_CCS811.h>
 
 class AirQualitySensorComponent {
+#ifdef TEST_BUILD
+    friend int main(int argc, char** argv);
+#endif
+
 private:
     static constexpr unsigned long m_interval = 30000;  // 30s
-    unsigned long m_lastact;
+    // The baseline drifts slowly; read it every 20 samples (10 min).
+    static constexpr uint8_t BASELINE_SAMPLES = 20;
+    Coroutine m_co;             // see loop()
+    uint32_t m_epoch;           // of the last sample (see Device)
     enum state {
         STATE_NONE,
         STATE_RESETTING,
@@ -17,19 +27,33 @@ private:
         STATE_FAILING
     } m_state;
 
-    Adafruit_CCS811* m_ccs811;
-    TwoWire* m_wire;
-    BinToggle& m_reset;
+    Adafruit_CCS811 m_ccs811;
+    I2CBus& m_bus;
+    I2CDevice m_i2cdev;
+    const int8_t m_pin_reset;   // nRESET (active low), or -1
+    const int8_t m_pin_nint;    // data ready (active low), or -1
+    uint16_t m_baseline;
+    uint8_t m_samples;          // since the last baseline read
 
 public:
-    AirQualitySensorComponent(TwoWire* theWire = &Wire, BinToggle& reset = NullToggle);
+    AirQualitySensorComponent(I2CBus& bus, int8_t pin_reset = -1, int8_t pin_nint = -1);
 
     void setup();
     void loop();
 
 private:
+    bool begin();
+    void set_state(enum state new_state);
     void dump_info();
+    void reset(bool on) {
+        if (m_pin_reset >= 0) {
+            digitalWrite(m_pin_reset, on ? LOW : HIGH);
+        }
+    }
     void sample();
+    static void sample_job(void* ctx) {
+        static_cast<AirQualitySensorComponent*>(ctx)->sample();
+    }
 };
 
 #endif //INCLUDED_PE32HUD_AIRQUALITYSENSORCOMPONENT_H
@@ -0,0 +1,53 @@
+#ifndef INCLUDED_PE32HUD_COMPONENTLIST_H
+#define INCLUDED_PE32HUD_COMPONENTLIST_H
+
+/* A fixed list of components, known at compile time:
+ *
+ *   static constexpr auto components = make_components(a, b, c);
+ *   components.setup();    // a.setup(); b.setup(); c.setup();
+ *   components.loop();     // a.loop(); b.loop(); c.loop();
+ *   components.setup(f);   // a.setup(); f(); b.setup(); f(); ...
+ *
+ * Each element is a reference to a global of its own type, so the
+ * calls are direct (and can be inlined), in list order. A component
+ * only needs setup() and loop(); there is no base class or vtable. */
+template<class... Cs> class ComponentList;
+
+template<> class ComponentList<> {
+public:
+    constexpr ComponentList() {}
+    void setup() const {}
+    void setup(void (*)()) const {}
+    void loop() const {}
+};
+
+template<class C, class... Cs>
+class ComponentList<C, Cs...> : private ComponentList<Cs...> {
+private:
+    C& m_component;
+
+public:
+    constexpr ComponentList(C& component, Cs&... rest) :
+        ComponentList<Cs...>(rest...), m_component(component) {}
+
+    void setup() const {
+        m_component.setup();
+        ComponentList<Cs...>::setup();
+    }
+    void setup(void (*after)()) const {
+        m_component.setup();
+        after();
+        ComponentList<Cs...>::setup(after);
+    }
+    void loop() const {
+        m_component.loop();
+        ComponentList<Cs...>::loop();
+    }
+};
+
+template<class... Cs> constexpr ComponentList<Cs...> make_components(Cs&... components)
+{
+    return ComponentList<Cs...>(components...);
+}
+
+#endif //INCLUDED_PE32HUD_COMPONENTLIST_H
@@ -0,0 +1,95 @@
+#ifndef INCLUDED_PE32HUD_CONCURRENCY_H
+#define INCLUDED_PE32HUD_CONCURRENCY_H
+
+#include <Arduino.h>
+
+/* With HAVE_DUALCORE (see pe32hud.h) the NetworkComponent runs on a core
+ * of its own and everything else in loop() on the other. They hand data
+ * to each other through SpscQueues (see Device). The few structures that
+ * both sides write to (Log, FlightRecorder) take a Mutex; without
+ * HAVE_DUALCORE that is a no-op. */
+
+#ifdef HAVE_DUALCORE
+#include <atomic>
+#ifdef TEST_THREADS
+#include <mutex>
+#include <thread>
+#endif
+#endif
+
+class Mutex {
+#if defined(HAVE_DUALCORE) && defined(ARDUINO_ARCH_ESP32)
+private:
+    StaticSemaphore_t m_buf;
+    SemaphoreHandle_t m_sem;
+public:
+    Mutex() : m_sem(xSemaphoreCreateMutexStatic(&m_buf)) {}
+    void lock() { xSemaphoreTake(m_sem, portMAX_DELAY); }
+    void unlock() { xSemaphoreGive(m_sem); }
+#elif defined(HAVE_DUALCORE)
+private:
+    std::mutex m_mutex;
+public:
+    void lock() { m_mutex.lock(); }
+    void unlock() { m_mutex.unlock(); }
+#else
+public:
+    void lock() {}
+    void unlock() {}
+#endif
+};
+
+class MutexLock {
+private:
+    Mutex& m_mutex;
+public:
+    MutexLock(Mutex& mutex) : m_mutex(mutex) { m_mutex.lock(); }
+    ~MutexLock() { m_mutex.unlock(); }
+};
+
+#ifdef HAVE_DUALCORE
+#ifdef ARDUINO_ARCH_ESP32
+typedef TaskHandle_t task_id;
+inline task_id current_task() { return xTaskGetCurrentTaskHandle(); }
+#else
+typedef std::thread::id task_id;
+inline task_id current_task() { return std::this_thread::get_id(); }
+#endif
+
+/* Lock-free queue for exactly one producer and one consumer (each on
+ * its own core). Holds N-1 items. The producer only writes m_tail, the
+ * consumer only m_head; the release/acquire pair makes the slot
+ * contents visible before the index that publishes them. */
+template<class T, uint8_t N> class SpscQueue {
+private:
+    T m_buf[N];
+    std::atomic<uint8_t> m_head;    // next to pop
+    std::atomic<uint8_t> m_tail;    // next to push
+
+public:
+    SpscQueue() : m_head(0), m_tail(0) {}
+
+    bool push(const T& item) {
+        uint8_t tail = m_tail.load(std::memory_order_relaxed);
+        uint8_t next = (tail + 1) % N;
+        if (next == m_head.load(std::memory_order_acquire)) {
+            return false;  // full
+        }
+        m_buf[tail] = item;
+        m_tail.store(next, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T& item) {
+        uint8_t head = m_head.load(std::memory_order_relaxed);
+        if (head == m_tail.load(std::memory_order_acquire)) {
+            return false;  // empty
+        }
+        item = static_cast<T&&>(m_buf[head]);
+        m_head.store((head + 1) % N, std::memory_order_release);
+        return true;
+    }
+};
+#endif
+
+#endif //INCLUDED_PE32HUD_CONCURRENCY_H
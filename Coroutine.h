@@ -0,0 +1,97 @@
+#ifndef INCLUDED_PE32HUD_COROUTINE_H
+#define INCLUDED_PE32HUD_COROUTINE_H
+
+#include "pe32hud.h"
+
+/* Stackless coroutines (protothreads) for the component loop()s, so a
+ * sequence like reset, wait, wake, wait, begin reads as one function
+ * instead of a switch over states and m_lastact bookkeeping:
+ *
+ *   void Foo::loop() {
+ *       if (!m_co.is_due()) {
+ *           return;                     // asleep in CO_AWAIT_MS
+ *       }
+ *       CO_BEGIN(m_co);
+ *       for (;;) {
+ *           power_on();
+ *           CO_AWAIT_MS(m_co, 20);      // back to loop() for 20ms
+ *           CO_AWAIT(m_co, is_ready());
+ *           CO_AWAIT_I2C(m_co, m_bus, m_i2cdev, &job, this, I2CBus::PRIO_HIGH);
+ *       }
+ *       CO_END(m_co);
+ *   }
+ *
+ * The Coroutine only stores where to resume (the source line) and a
+ * deadline; there is no stack and no heap. That comes with the usual
+ * protothread rules:
+ * - locals do not survive an await; keep state in members;
+ * - no awaits inside a switch of your own;
+ * - the function returns void, and at most one await per line.
+ *
+ * CO_AWAIT_MS sets a deadline; until then is_due() is a cheap check
+ * that lets loop() skip the body altogether. Other awaits evaluate
+ * their condition on every loop(). */
+class Coroutine {
+private:
+    uint16_t m_resume;          // 0, or the label to continue at
+    unsigned long m_since;      // millis() at the start of CO_AWAIT_MS
+    unsigned long m_sleep;      // ms from m_since, 0 when not sleeping
+
+public:
+    Coroutine() : m_resume(0), m_since(0), m_sleep(0) {}
+
+    // Start at CO_BEGIN again on the next loop().
+    void restart() { m_resume = 0; m_sleep = 0; }
+    bool is_due() const { return !m_sleep || (millis() - m_since) >= m_sleep; }
+
+    // For the CO_ macros.
+    uint16_t get_resume() const { return m_resume; }
+    void set_resume(uint16_t resume) { m_resume = resume; }
+    void sleep(unsigned long ms) { m_since = millis(); m_sleep = ms; }
+    bool wake() {
+        if (!is_due()) {
+            return false;
+        }
+        m_sleep = 0;
+        return true;
+    }
+};
+
+// Labels are two per line, so a macro can hold two awaits.
+#define CO_LABEL_(n) ((__LINE__ << 1) | (n))
+#define CO_AWAIT_AT_(co, label, cond) \
+    (co).set_resume(label); \
+    /* fall through */ \
+    case label: \
+    if (!(cond)) { \
+        return; \
+    }
+
+#define CO_BEGIN(co) switch ((co).get_resume()) { case 0:
+#define CO_END(co) } (co).restart()
+
+// Back to loop(); continue here on the next one.
+#define CO_YIELD(co) \
+    do { \
+        (co).set_resume(CO_LABEL_(0)); \
+        return; \
+        case CO_LABEL_(0):; \
+    } while (0)
+
+// Continue once cond is true; it is evaluated on every loop().
+#define CO_AWAIT(co, cond) \
+    do { CO_AWAIT_AT_(co, CO_LABEL_(0), (cond)) } while (0)
+
+// Continue after at least ms milliseconds.
+#define CO_AWAIT_MS(co, ms) \
+    do { (co).sleep(ms); CO_AWAIT_AT_(co, CO_LABEL_(0), (co).wake()) } while (0)
+
+// Run fn(ctx) as an I2CBus job (see I2CBus::enqueue()) and continue
+// once it has run. A full queue is retried on the next loop().
+#define CO_AWAIT_I2C(co, bus, dev, fn, ctx, prio) \
+    do { \
+        CO_AWAIT_AT_(co, CO_LABEL_(0), (bus).enqueue((dev), (fn), (ctx), (prio))) \
+        CO_AWAIT_AT_(co, CO_LABEL_(1), !(bus).is_pending((fn), (ctx))) \
+    } while (0)
+
+#endif //INCLUDED_PE32HUD_COROUTINE_H
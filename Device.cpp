@@ -1,22 +1,59 @@
 #include "Device.h"
 
 #include "DisplayComponent.h"
+#include "FlightRecorder.h"
 #include "LedStatusComponent.h"
 #include "NetworkComponent.h"
 #include "SunscreenComponent.h"
 
+extern FlightRecorder FlightRecorder;
+
 void Device::set_text(const String& msg0, const String& msg1, unsigned long color)
 {
+#ifdef HAVE_DUALCORE
+    if (on_network_core()) {
+        HudCall call;
+        call.kind = HudCall::TEXT;
+        call.color = color;
+        call.msg0 = msg0;
+        call.msg1 = msg1;
+        queue(call);
+        return;
+    }
+#endif
     m_displaycomponent->set_text(msg0, msg1, color);
 }
 
 void Device::set_error(const String& msg0, const String& msg1)
 {
-    m_displaycomponent->set_text(msg0, msg1, COLOR_YELLOW);
+    set_text(msg0, msg1, COLOR_YELLOW);
+}
+
+void Device::set_stale(bool stale)
+{
+#ifdef HAVE_DUALCORE
+    if (on_network_core()) {
+        HudCall call;
+        call.kind = HudCall::STALE;
+        call.arg = stale;
+        queue(call);
+        return;
+    }
+#endif
+    m_displaycomponent->set_stale(stale);
 }
 
 void Device::set_or_clear_alert(enum alert al, bool is_alert)
 {
+#ifdef HAVE_DUALCORE
+    if (on_network_core()) {
+        HudCall call;
+        call.kind = (is_alert ? HudCall::ALERT : HudCall::CLEAR_ALERT);
+        call.arg = al;
+        queue(call);
+        return;
+    }
+#endif
     if (is_alert) {
         m_alerts |= al;
     } else {
@@ -40,6 +77,15 @@ void Device::set_or_clear_alert(enum alert al, bool is_alert)
 
 void Device::add_action(enum action atn)
 {
+#ifdef HAVE_DUALCORE
+    if (on_network_core()) {
+        HudCall call;
+        call.kind = HudCall::ACTION;
+        call.arg = atn;
+        queue(call);
+        return;
+    }
+#endif
     if (atn & ACTION_SUNSCREEN) {
         if (m_lastsunscreen != atn) {
             switch (atn) {
@@ -60,7 +106,162 @@ void Device::add_action(enum action atn)
     }
 }
 
-void Device::publish(const String& topic, const String& formdata)
+void Device::set_reading(enum reading rd, float value)
+{
+#ifdef HAVE_DUALCORE
+    if (on_network_core()) {
+        HudCall call;
+        call.kind = HudCall::READING;
+        call.arg = rd;
+        call.value = value;
+        queue(call);
+        return;
+    }
+#endif
+    uint8_t& head = m_historyhead[rd];
+    m_history[rd][head] = value;
+    head = (head + 1) % HISTORY_SIZE;
+    if (m_historylen[rd] < HISTORY_SIZE) {
+        m_historylen[rd] += 1;
+    }
+    bool changed = !(m_hasreadings & (1 << rd)) || m_readings[rd] != value;
+    m_readings[rd] = value;
+    m_hasreadings |= (1 << rd);
+    m_displaycomponent->update_readings(changed ? (1 << rd) : 0, 1 << rd);
+}
+
+uint8_t Device::get_history(enum reading rd, float values[HISTORY_SIZE]) const
+{
+    uint8_t len = m_historylen[rd];
+    uint8_t idx = (m_historyhead[rd] + HISTORY_SIZE - len) % HISTORY_SIZE;
+    for (uint8_t i = 0; i < len; ++i) {
+        values[i] = m_history[rd][(idx + i) % HISTORY_SIZE];
+    }
+    return len;
+}
+
+void Device::publish(const __FlashStringHelper* topic, const String& formdata)
 {
+#ifdef HAVE_DUALCORE
+    if (!on_network_core()) {
+        PublishCall call;
+        call.topic = topic;
+        call.formdata = formdata;
+        if (!m_publishq.push(call)) {
+            m_dropped += 1;
+        }
+        return;
+    }
+#endif
     m_networkcomponent->push_remote(topic, formdata);
 }
+
+void Device::loop()
+{
+    unsigned long elapsed = millis() - m_epochstart;
+    if (elapsed >= EPOCH_MS) {
+        // Stay on the ticks, also when we missed one.
+        m_epochstart += elapsed - elapsed % EPOCH_MS;
+        m_epoch += elapsed / EPOCH_MS;
+    }
+#if TELEMETRY_COMBINED
+    if (m_telemetrysensors && (m_telemetryepoch != m_epoch ||
+            (millis() - m_telemetrysince) >= TELEMETRY_WAIT_MS)) {
+        publish_telemetry();  // not everyone made it in time
+    }
+#endif
+}
+
+void Device::telemetry(
+    enum sensor sn, uint32_t epoch, const __FlashStringHelper* topic, const String& formdata)
+{
+#if TELEMETRY_COMBINED
+    (void)topic;
+    if (m_telemetrysensors && m_telemetryepoch != epoch) {
+        publish_telemetry();
+    }
+    if (!m_telemetrysensors) {
+        m_telemetrysince = millis();
+    }
+    m_telemetryepoch = epoch;
+    m_telemetry[sn] = formdata;
+    m_telemetrysensors |= (1 << sn);
+    if (m_telemetrysensors == (1 << NUM_SENSORS) - 1) {
+        publish_telemetry();
+    }
+#else
+    (void)sn;
+    (void)epoch;
+    publish(topic, formdata);
+#endif
+}
+
+#if TELEMETRY_COMBINED
+void Device::publish_telemetry()
+{
+    // The boot count and epoch make an exact key for the backend.
+    String formdata;
+    formdata.reserve(112);
+    formdata += F("boot=");
+    formdata += FlightRecorder.get_bootcount();
+    formdata += F("&seq=");
+    formdata += m_telemetryepoch;
+    for (uint8_t sn = 0; sn < NUM_SENSORS; ++sn) {
+        if (m_telemetrysensors & (1 << sn)) {
+            formdata += '&';
+            formdata += m_telemetry[sn];
+        }
+    }
+    m_telemetrysensors = 0;
+    publish(F("pe32/hud/telemetry/xwwwform"), formdata);
+}
+#endif
+
+#ifdef HAVE_DUALCORE
+bool Device::queue(const HudCall& call)
+{
+    if (!m_hudq.push(call)) {
+        m_dropped += 1;
+        return false;
+    }
+    return true;
+}
+
+void Device::apply_queued()
+{
+    HudCall call;
+    while (m_hudq.pop(call)) {
+        switch (call.kind) {
+        case HudCall::TEXT:
+            set_text(call.msg0, call.msg1, call.color);
+            break;
+        case HudCall::STALE:
+            set_stale(call.arg);
+            break;
+        case HudCall::ALERT:
+            set_alert(static_cast<enum alert>(call.arg));
+            break;
+        case HudCall::CLEAR_ALERT:
+            clear_alert(static_cast<enum alert>(call.arg));
+            break;
+        case HudCall::ACTION:
+            add_action(static_cast<enum action>(call.arg));
+            break;
+        case HudCall::READING:
+            set_reading(static_cast<enum reading>(call.arg), call.value);
+            break;
+        }
+    }
+}
+
+bool Device::take_publish(const __FlashStringHelper*& topic, String& formdata)
+{
+    PublishCall call;
+    if (!m_publishq.pop(call)) {
+        return false;
+    }
+    topic = call.topic;
+    formdata = call.formdata;
+    return true;
+}
+#endif
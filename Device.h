@@ -3,6 +3,12 @@
 
 #include "pe32hud.h"
 
+// Send one telemetry message per sampling epoch with the readings of
+// all sensors, instead of a message per sensor on its own topic.
+#ifndef TELEMETRY_COMBINED
+#define TELEMETRY_COMBINED 1
+#endif
+
 class DisplayComponent;
 class LedStatusComponent;
 class NetworkComponent;
@@ -23,6 +29,24 @@ public:
         COLOR_GREEN = 0x00ff00,
         COLOR_BLUE = 0x0000ff
     };
+    // Local readings, for templated HUD lines (see HudTemplate.h).
+    enum reading {
+        READING_ECO2 = 0,       // ppm
+        READING_TVOC = 1,       // ppb
+        READING_TEMP = 2,       // 'C
+        READING_HUMIDITY = 3,   // %RH
+        READING_RSSI = 4,       // dBm
+        NUM_READINGS = 5
+    };
+    static constexpr uint8_t HISTORY_SIZE = 10;    // samples per reading
+    // Sensors that report in each sampling epoch.
+    enum sensor {
+        SENSOR_CCS811 = 0,
+        SENSOR_DHT11 = 1,
+        NUM_SENSORS = 2
+    };
+    static constexpr unsigned long EPOCH_MS = 30000;
+    static constexpr unsigned long TELEMETRY_WAIT_MS = 10000;  // for stragglers
     enum alert {
         BOOTING = 1,
         INACTIVE_WIFI = 2,
@@ -31,6 +55,22 @@ public:
         NOTIFY_SUNSCREEN = 16
     };
 
+#ifdef HAVE_DUALCORE
+    // Calls from the network core that touch the application side.
+    struct HudCall {
+        enum kind { TEXT, STALE, ALERT, CLEAR_ALERT, ACTION, READING } kind;
+        uint8_t arg;            // alert, action or reading
+        unsigned long color;
+        float value;
+        String msg0;
+        String msg1;
+    };
+    struct PublishCall {
+        const __FlashStringHelper* topic;
+        String formdata;
+    };
+#endif
+
 private:
     /* We use the guid to store something unique to identify the device by.
      * For now, we'll populate it with the ESP8266 Wifi MAC address. */
@@ -44,9 +84,43 @@ private:
     enum action m_lastsunscreen;
     uint8_t m_alerts;
 
+    float m_readings[NUM_READINGS];
+    uint8_t m_hasreadings;      // bitmask of (1 << reading)
+    float m_history[NUM_READINGS][HISTORY_SIZE];    // ring per reading
+    uint8_t m_historyhead[NUM_READINGS];            // next to write
+    uint8_t m_historylen[NUM_READINGS];
+
+    uint32_t m_epoch;           // sampling epochs since boot
+    unsigned long m_epochstart; // millis() at its tick
+#if TELEMETRY_COMBINED
+    uint32_t m_telemetryepoch;
+    unsigned long m_telemetrysince; // millis() at the first sensor
+    uint8_t m_telemetrysensors; // bitmask of (1 << sensor) in m_telemetry
+    String m_telemetry[NUM_SENSORS];
+#endif
+
+#ifdef HAVE_DUALCORE
+    SpscQueue<HudCall, 8> m_hudq;           // network -> application
+    SpscQueue<PublishCall, 8> m_publishq;   // application -> network
+    std::atomic<task_id> m_networktask;
+    std::atomic<unsigned long> m_dropped;
+#endif
+
 public:
     Device()
-        : m_lastsunscreen(ACTION_SUNSCREEN_NONE) { memcpy(m_guid, "EUI48:11:22:33:44:55:66", 24); }
+        : m_lastsunscreen(ACTION_SUNSCREEN_NONE), m_hasreadings(0),
+          m_epoch(0), m_epochstart(0)
+#if TELEMETRY_COMBINED
+        , m_telemetryepoch(0), m_telemetrysince(0), m_telemetrysensors(0)
+#endif
+#ifdef HAVE_DUALCORE
+        , m_networktask(task_id()), m_dropped(0)
+#endif
+    {
+        strcpy_P(m_guid, PSTR("EUI48:11:22:33:44:55:66"));
+        memset(m_historyhead, 0, sizeof(m_historyhead));
+        memset(m_historylen, 0, sizeof(m_historylen));
+    }
 
     void set_displaycomponent(DisplayComponent* displaycomponent) {
         m_displaycomponent = displaycomponent;
@@ -66,16 +140,57 @@ public:
 
     void set_text(const String& msg0, const String& msg1, unsigned long color);
     void set_error(const String& msg0, const String& msg1);
+    // The text is from an older HUD payload; see DisplayComponent.
+    void set_stale(bool stale);
 
     void set_alert(enum alert al) { set_or_clear_alert(al, true); }
     void clear_alert(enum alert al) { set_or_clear_alert(al, false); }
 
     void add_action(enum action atn);
 
-    void publish(const String& topic, const String& formdata);
+    void set_reading(enum reading rd, float value);
+    bool get_reading(enum reading rd, float& value) const {
+        value = m_readings[rd];
+        return m_hasreadings & (1 << rd);
+    }
+    // The last samples of a reading, oldest first, also those that did
+    // not change it. Returns how many (up to HISTORY_SIZE).
+    uint8_t get_history(enum reading rd, float values[HISTORY_SIZE]) const;
+
+    void publish(const __FlashStringHelper* topic, const String& formdata);
+
+    /* Sampling epochs: every EPOCH_MS since boot, on the same ticks for
+     * all sensors. A sensor samples when get_epoch() changes and hands
+     * its form data to telemetry(). With TELEMETRY_COMBINED, that goes
+     * out as one "boot=<n>&seq=<epoch>&..." message once all sensors
+     * are in, or TELEMETRY_WAIT_MS after the first with what we have.
+     * Otherwise each sensor publishes on its own topic. */
+    void loop();
+    uint32_t get_epoch() const { return m_epoch; }
+    void telemetry(enum sensor sn, uint32_t epoch,
+                   const __FlashStringHelper* topic, const String& formdata);
+
+#ifdef HAVE_DUALCORE
+    /* With HAVE_DUALCORE, the HUD calls above (text, stale, alerts, actions,
+     * readings) made on the network core are queued, and applied on the
+     * application core by apply_queued() in loop(). publish() from the
+     * application core is queued for the network core, which picks it
+     * up with take_publish(). */
+    void set_network_task(task_id task) { m_networktask = task; }
+    bool on_network_core() const { return current_task() == m_networktask; }
+    void apply_queued();
+    bool take_publish(const __FlashStringHelper*& topic, String& formdata);
+    unsigned long get_dropped() const { return m_dropped; }
+#endif
 
 private:
     void set_or_clear_alert(enum alert al, bool is_alert);
+#if TELEMETRY_COMBINED
+    void publish_telemetry();
+#endif
+#ifdef HAVE_DUALCORE
+    bool queue(const HudCall& call);
+#endif
 };
 
 #endif //INCLUDED_PE32HUD_DEVICE_H
@@ -0,0 +1,181 @@
+#include "Dht11Reader.h"
+
+#include <math.h>          // NAN
+
+Dht11Reader* Dht11Reader::s_active;
+
+Dht11Reader::Dht11Reader(uint8_t pin) :
+    m_state(STATE_IDLE),
+    m_pin(pin),
+    m_polled(digitalPinToInterrupt(pin) == NOT_AN_INTERRUPT),
+    m_tries(0),
+    m_status(STATUS_TIMEOUT),
+    m_since(0),
+    m_nedges(0)
+#ifdef TEST_BUILD
+    , m_respond(NULL), m_respondctx(NULL)
+#endif
+{
+}
+
+void Dht11Reader::setup()
+{
+    // The module has its own pull-up (and INPUT_PULLUP is not there on
+    // every pin).
+    pinMode(m_pin, INPUT);
+}
+
+void Dht11Reader::start()
+{
+    if (m_state != STATE_IDLE) {
+        return;  // still busy with the previous read
+    }
+    m_tries = 0;
+    m_state = STATE_START;
+    m_since = millis();
+    pinMode(m_pin, OUTPUT);
+    digitalWrite(m_pin, LOW);
+}
+
+bool Dht11Reader::loop()
+{
+    switch (m_state) {
+    case STATE_IDLE:
+        break;
+
+    case STATE_START:
+        if ((millis() - m_since) >= START_MS) {
+            release();
+        }
+        break;
+
+    case STATE_CAPTURE:
+        if (!m_polled && m_nedges < NUM_EDGES && (millis() - m_since) < CAPTURE_MS) {
+            break;
+        }
+        if (!m_polled) {
+            detachInterrupt(digitalPinToInterrupt(m_pin));
+            s_active = NULL;
+        }
+        m_tries += 1;
+        m_status = decode();
+        if (m_status == STATUS_OK || m_tries >= MAX_TRIES) {
+            m_state = STATE_IDLE;
+            return true;
+        }
+        LOG_DEBUG(TEMPERATURE) << F("Dht11Reader: ") << get_status_string() <<  // (idefix)
+            F(" with ") << m_nedges << F(" edges, retrying\r\n");
+        m_state = STATE_RETRY;
+        m_since = millis();
+        break;
+
+    case STATE_RETRY:
+        if ((millis() - m_since) >= RETRY_MS) {
+            m_state = STATE_START;
+            m_since = millis();
+            pinMode(m_pin, OUTPUT);
+            digitalWrite(m_pin, LOW);
+        }
+        break;
+    }
+    return false;
+}
+
+void Dht11Reader::release()
+{
+    // Arm the interrupt first: the sensor answers 20-40 us after the
+    // line goes up.
+    m_nedges = 0;
+    if (!m_polled) {
+        s_active = this;
+        attachInterrupt(digitalPinToInterrupt(m_pin), on_falling, FALLING);
+    }
+    pinMode(m_pin, INPUT);
+    m_state = STATE_CAPTURE;
+    m_since = millis();
+#ifdef TEST_BUILD
+    if (m_respond) {
+        m_respond(m_respondctx, *this);
+    }
+#endif
+    if (m_polled) {
+        poll();
+    }
+}
+
+void Dht11Reader::poll()
+{
+    // A digitalRead() is about a microsecond, well below the 27 us of
+    // the shortest high.
+    uint32_t start = micros();
+    int level = HIGH;
+    while (m_nedges < NUM_EDGES && (micros() - start) < POLL_US) {
+        int now = digitalRead(m_pin);
+        if (level == HIGH && now == LOW) {
+            edge(micros());
+        }
+        level = now;
+    }
+}
+
+Dht11Reader::status Dht11Reader::decode()
+{
+    // The last 41 edges bound the 40 bits, whether or not we caught the
+    // start of the response.
+    uint8_t n = m_nedges;
+    if (n < 41) {
+        return STATUS_TIMEOUT;
+    }
+    memset(m_data, 0, sizeof(m_data));
+    for (uint8_t i = 0; i < 40; ++i) {
+        uint32_t dt = m_edges[n - 40 + i] - m_edges[n - 41 + i];
+        if (dt < MIN_BIT_US || dt > MAX_BIT_US) {
+            return STATUS_TIMEOUT;
+        }
+        if (dt > ONE_US) {
+            m_data[i / 8] |= (0x80 >> (i % 8));
+        }
+    }
+    if (static_cast<uint8_t>(m_data[0] + m_data[1] + m_data[2] + m_data[3]) != m_data[4]) {
+        return STATUS_CHECKSUM;
+    }
+    return STATUS_OK;
+}
+
+const __FlashStringHelper* Dht11Reader::get_status_string() const
+{
+    // As DHTesp::getStatusString() had them.
+    switch (m_status) {
+    case STATUS_OK:
+        return F("OK");
+    case STATUS_CHECKSUM:
+        return F("CHECKSUM");
+    default:
+        return F("TIMEOUT");
+    }
+}
+
+float Dht11Reader::get_temperature() const
+{
+    if (m_status != STATUS_OK) {
+        return NAN;
+    }
+    // Tenths in the low 7 bits of the decimal byte, bit 7 is the sign.
+    float temperature = m_data[2] + (m_data[3] & 0x7f) * 0.1f;
+    return (m_data[3] & 0x80) ? -temperature : temperature;
+}
+
+float Dht11Reader::get_humidity() const
+{
+    if (m_status != STATUS_OK) {
+        return NAN;
+    }
+    return m_data[0] + m_data[1] * 0.1f;
+}
+
+void IRAM_ATTR Dht11Reader::on_falling()
+{
+    if (s_active) {
+        s_active->edge(micros());
+    }
+}
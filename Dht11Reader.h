@@ -0,0 +1,110 @@
+#ifndef INCLUDED_PE32HUD_DHT11READER_H
+#define INCLUDED_PE32HUD_DHT11READER_H
+
+#include "pe32hud.h"
+
+/* Non-blocking DHT11 reader.
+ *
+ * A library read bit-bangs the whole exchange with interrupts off for
+ * 20+ ms. Here start() pulls the line low for the start signal and
+ * returns; a later loop() releases it and lets a FALLING edge interrupt
+ * timestamp the response. Every bit starts with a ~50 us low followed
+ * by a ~27 us (0) or ~70 us (1) high, so the time between two falling
+ * edges tells the bit:
+ *
+ *   host low 18+ ms | resp 80+80 | 40x (50 + 27/70) | 50
+ *   falling edges:    ^            ^    ^ ...          ^     (42)
+ *
+ * loop() decodes the last 41 edges once they are in (or the capture
+ * timed out), checks the checksum, and starts over after a second on
+ * failure, up to MAX_TRIES times. No step keeps the CPU for more than
+ * a few microseconds.
+ *
+ * A pin without interrupts (GPIO16 on the ESP8266) is polled instead:
+ * release() then samples the line itself until all edges are in, or
+ * for at most POLL_US. That keeps the CPU for ~5 ms per try, but with
+ * interrupts on; an edge that is late because of them shows up as bad
+ * bit timing, and the read is retried. */
+class Dht11Reader {
+#ifdef TEST_BUILD
+    friend int main(int argc, char** argv);
+#endif
+
+public:
+    enum status {
+        STATUS_OK = 0,
+        STATUS_TIMEOUT,         // too few edges, or bad bit timing
+        STATUS_CHECKSUM
+    };
+    static constexpr uint8_t MAX_TRIES = 3;
+#ifdef TEST_BUILD
+    // The sensor stand-in: called with the line just released.
+    typedef void (*respond_fn)(void* ctx, Dht11Reader& reader);
+#endif
+
+private:
+    static constexpr uint8_t NUM_EDGES = 42;
+    static constexpr unsigned long START_MS = 20;     // DHT11: >= 18 ms
+    static constexpr unsigned long CAPTURE_MS = 10;   // response is ~5 ms
+    static constexpr uint32_t POLL_US = 6000;         // without interrupts
+    static constexpr unsigned long RETRY_MS = 1100;   // at most 1 read/s
+    static constexpr uint32_t ONE_US = 100;           // 50+27 vs 50+70
+    static constexpr uint32_t MIN_BIT_US = 60;
+    static constexpr uint32_t MAX_BIT_US = 160;
+
+    enum state {
+        STATE_IDLE,
+        STATE_START,            // holding the line low
+        STATE_CAPTURE,          // line released, edges coming in
+        STATE_RETRY             // waiting to start over
+    } m_state;
+
+    const uint8_t m_pin;
+    const bool m_polled;        // no interrupt on m_pin
+    uint8_t m_tries;
+    enum status m_status;
+    unsigned long m_since;      // millis() at entering m_state
+    uint8_t m_data[5];          // RH int, RH dec, T int, T dec, sum
+
+    volatile uint32_t m_edges[NUM_EDGES];   // micros() of falling edges
+    volatile uint8_t m_nedges;
+
+    static Dht11Reader* s_active;           // for the ISR
+#ifdef TEST_BUILD
+    respond_fn m_respond;
+    void* m_respondctx;
+#endif
+
+public:
+    Dht11Reader(uint8_t pin);
+
+    void setup();
+    void start();
+    bool loop();                // true once a read (or all tries) is done
+
+    enum status get_status() const { return m_status; }
+    const __FlashStringHelper* get_status_string() const;
+    float get_temperature() const;  // NAN unless STATUS_OK
+    float get_humidity() const;
+
+    // Record a falling edge at us; from the pin ISR.
+    void IRAM_ATTR edge(uint32_t us) {
+        uint8_t n = m_nedges;
+        if (n < NUM_EDGES) {
+            m_edges[n] = us;
+            m_nedges = n + 1;
+        }
+    }
+
+#ifdef TEST_BUILD
+    void set_responder(respond_fn fn, void* ctx) { m_respond = fn; m_respondctx = ctx; }
+#endif
+
+private:
+    void release();
+    void poll();
+    enum status decode();
+    static void IRAM_ATTR on_falling();
+};
+
+#endif //INCLUDED_PE32HUD_DHT11READER_H
@@ -2,64 +2,155 @@
 
 #include "Device.h"
 
-#include <rgb_lcd.h>        // Grove_-_LCD_RGB_Backlight
-
 extern Device Device;
 
-class rgb_lcd_plus : public rgb_lcd {
-public:
-  inline void setColor(uint32_t color) {
-    setRGB(
-      (color & 0xff0000) >> 16,
-      (color & 0x00ff00) >> 8,
-      (color & 0x0000ff));
-  }
-};
-
-DisplayComponent::DisplayComponent(TwoWire* theWire) :
-    // FIXME: rbg_lcd.h does not actually use this theWire
-    m_lcd(new rgb_lcd_plus),
+DisplayComponent::DisplayComponent(I2CBus& bus) :
+    m_bus(bus),
+    // Both the LCD (0x3E) and the backlight (0x62) do 400kHz. We account
+    // the traffic to both on this one device.
+    m_i2cdev(F("lcd"), 0x3E, 400000),
     m_message0(F("Initializing...")),
     m_bgcolor(Device::COLOR_YELLOW),
-    m_hasupdate(true)
+    m_dirty(DIRTY_COLOR | DIRTY_LINE0 | DIRTY_LINE1),
+    m_hasupdate(true),
+    m_stale(false)
 {
+    memset(m_rowglyphs, 0, sizeof(m_rowglyphs));
 }
 
 void DisplayComponent::setup()
 {
     Device.set_alert(Device::BOOTING);  // useless if set/clear in setup()
-    m_lcd->begin(LCD_COLS, LCD_ROWS);  // 16 cols, 2 rows
+    m_bus.acquire(m_i2cdev);
+    m_lcd.begin(LCD_COLS, LCD_ROWS);  // 16 cols, 2 rows
+    m_bus.release();
     Device.clear_alert(Device::BOOTING);
 }
 
 void DisplayComponent::loop()
 {
     if (m_hasupdate) {
-#ifdef DEBUG
-        Serial << F("  --DisplayComponent: show\r\n");
-#endif
-        show();
+        LOG_DEBUG(DISPLAY) << F("  --DisplayComponent: show\r\n");
+        LOG_INFO(DISPLAY) << F("HUD:    [") <<  // header
+            LogLcd(m_message0) << F("] [") <<  // top message
+            LogLcd(m_message1) << F("]\r\n");  // bottom message
+        m_bus.enqueue(m_i2cdev, &show_job, this, I2CBus::PRIO_LOW);
         m_hasupdate = false;
     }
 }
 
 void DisplayComponent::set_text(String msg0, String msg1, uint32_t color)
 {
-    m_message0 = msg0;
-    m_message1 = msg1;
-    m_bgcolor = color;
-    m_hasupdate = true;
+    if (color != m_bgcolor) {
+        m_bgcolor = color;
+        m_dirty |= DIRTY_COLOR;
+    }
+    m_template0.compile(msg0);
+    m_template1.compile(msg1);
+    render(0, m_template0, m_message0);
+    render(1, m_template1, m_message1);
+}
+
+void DisplayComponent::set_stale(bool stale)
+{
+    if (stale != m_stale) {
+        m_stale = stale;
+        render(0, m_template0, m_message0);
+    }
+}
+
+void DisplayComponent::update_readings(uint8_t values, uint8_t histories)
+{
+    // Only lines that show one of these readings change.
+    if (m_template0.uses(values) || m_template0.uses_history(histories)) {
+        render(0, m_template0, m_message0);
+    }
+    if (m_template1.uses(values) || m_template1.uses_history(histories)) {
+        render(1, m_template1, m_message1);
+    }
+}
+
+void DisplayComponent::render(uint8_t row, const HudTemplate& tpl, String& message)
+{
+    // The glyphs on the other rows stay; those of the old version of
+    // this line may be reused.
+    uint8_t keep = 0;
+    for (uint8_t i = 0; i < LCD_ROWS; ++i) {
+        keep |= (i != row ? m_rowglyphs[i] : 0);
+    }
+    String line;
+    m_glyphs.begin(keep);
+    tpl.render(line, m_glyphs);
+    if (row == 0 && m_stale) {
+        // Padded or cut, so the mark lands in the last column.
+        while (line.length() < LCD_COLS - 1) {
+            line += ' ';
+        }
+        line = line.substring(0, LCD_COLS - 1);
+        line += LCD_STALE_MARK;
+    }
+    m_rowglyphs[row] = m_glyphs.get_line();
+    if (m_glyphs.get_dirty()) {
+        m_dirty |= DIRTY_GLYPHS;  // also when the text stays the same
+    }
+    if (line != message) {
+        message = line;
+        m_dirty |= (row ? DIRTY_LINE1 : DIRTY_LINE0);
+    }
+    if (m_dirty) {
+        m_hasupdate = true;
+    }
 }
 
 void DisplayComponent::show()
 {
-    m_lcd->setColor(m_bgcolor);
-    m_lcd->clear();
-    m_lcd->setCursor(0, 0);
-    m_lcd->print(m_message0.c_str());
-    m_lcd->setCursor(0, 1);
-    m_lcd->print(m_message1.c_str());
-    Serial << F("HUD:    [") <<  // header
-        m_message0 << F("] [") <<  // top message
-        m_message1 << F("]\r\n");  // bottom message
+    // Update one part per bus job, so other devices get a turn in
+    // between. Lines are overwritten (padded) instead of using the slow
+    // clear() command.
+    if (m_dirty & DIRTY_COLOR) {
+        show_color();
+        m_dirty &= ~DIRTY_COLOR;
+    } else if (m_dirty & DIRTY_GLYPHS) {
+        // Before the lines that use them.
+        show_glyphs();
+        m_dirty &= ~DIRTY_GLYPHS;
+    } else if (m_dirty & DIRTY_LINE0) {
+        show_line(0, m_message0);
+        m_dirty &= ~DIRTY_LINE0;
+    } else if (m_dirty & DIRTY_LINE1) {
+        show_line(1, m_message1);
+        m_dirty &= ~DIRTY_LINE1;
+    }
+    if (m_dirty) {
+        m_bus.enqueue(m_i2cdev, &show_job, this, I2CBus::PRIO_LOW);
+    }
+}
+
+void DisplayComponent::show_color()
+{
+    m_lcd.setRGB(
+        (m_bgcolor & 0xff0000) >> 16,
+        (m_bgcolor & 0x00ff00) >> 8,
+        (m_bgcolor & 0x0000ff));
+}
+
+void DisplayComponent::show_glyphs()
+{
+    uint8_t dirty = m_glyphs.get_dirty();
+    for (uint8_t slot = 0; slot < GlyphCache::NUM_SLOTS; ++slot) {
+        if (dirty & (1 << slot)) {
+            uint8_t rows[GlyphCache::ROWS];
+            m_glyphs.take(slot, rows);
+            m_lcd.createChar(slot, rows);
+        }
+    }
+}
+
+void DisplayComponent::show_line(uint8_t row, const String& message)
+{
+    uint8_t len = (message.length() < LCD_COLS ? message.length() : LCD_COLS);
+    m_lcd.setCursor(0, row);
+    for (uint8_t i = 0; i < LCD_COLS; ++i) {
+        m_lcd.write(i < len ? message[i] : ' ');
+    }
 }
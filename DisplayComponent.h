@@ -3,30 +3,67 @@
 
 #include "pe32hud.h"
 
+#include "GlyphCache.h"
+#include "HudTemplate.h"
+#include "I2CBus.h"
+
+#include <rgb_lcd.h>        // Grove_-_LCD_RGB_Backlight
+
 // Display on I2C, with a 16x2 matrix
 static constexpr int LCD_ROWS = 2;
 static constexpr int LCD_COLS = 16;
-
-class rgb_lcd_plus;
+// In the last column of the top row while the text is stale
+static constexpr char LCD_STALE_MARK = '?';
 
 class DisplayComponent {
+#ifdef TEST_BUILD
+    friend int main(int argc, char** argv);
+#endif
+
 private:
-    rgb_lcd_plus* m_lcd;
-    String m_message0;
+    enum dirty {
+        DIRTY_COLOR = 1,
+        DIRTY_LINE0 = 2,
+        DIRTY_LINE1 = 4,
+        DIRTY_GLYPHS = 8        // see GlyphCache::get_dirty()
+    };
+
+    // FIXME: rbg_lcd.h does not use the bus TwoWire, but the global Wire;
+    // which happens to be the same one.
+    rgb_lcd m_lcd;
+    I2CBus& m_bus;
+    I2CDevice m_i2cdev;
+    HudTemplate m_template0;
+    HudTemplate m_template1;
+    GlyphCache m_glyphs;
+    uint8_t m_rowglyphs[LCD_ROWS];  // slots used by each rendered line
+    String m_message0;          // as rendered
     String m_message1;
     unsigned long m_bgcolor;
+    uint8_t m_dirty;
     bool m_hasupdate;
+    bool m_stale;
 
 public:
-    DisplayComponent(TwoWire* theWire = &Wire);
+    DisplayComponent(I2CBus& bus);
 
     void setup();
     void loop();
 
     void set_text(String msg0, String msg1, uint32_t color);
+    void set_stale(bool stale);
+    // Readings whose value changed, and those that got a sample.
+    void update_readings(uint8_t values, uint8_t histories);
 
 private:
+    void render(uint8_t row, const HudTemplate& tpl, String& message);
     void show();
+    void show_color();
+    void show_glyphs();
+    void show_line(uint8_t row, const String& message);
+    static void show_job(void* ctx) {
+        static_cast<DisplayComponent*>(ctx)->show();
+    }
 };
 
 #endif //INCLUDED_PE32HUD_DISPLAYCOMPONENT_H
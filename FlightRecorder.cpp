@@ -0,0 +1,177 @@
+#include "FlightRecorder.h"
+
+#if defined(ARDUINO_ARCH_ESP32)
+#include <esp_system.h>     // esp_reset_reason
+#endif
+
+static constexpr uint32_t FLIGHTRECORDER_MAGIC = 0x70653332;  // "pe32"
+
+#if defined(ARDUINO_ARCH_ESP8266)
+// Offset in 4-byte blocks into the RTC user memory; skip the eboot area.
+static constexpr uint32_t RTC_OFFSET = 32;
+#endif
+
+// On the ESP32 the storage itself lives in RTC memory that is not
+// cleared on reset. Elsewhere it's plain RAM; the ESP8266 mirrors it
+// into RTC user memory on write.
+#if defined(ARDUINO_ARCH_ESP32)
+RTC_NOINIT_ATTR
+#endif
+FlightRecorder::Storage FlightRecorder::s_storage;
+
+FlightRecorder::FlightRecorder() :
+    m_published(false)
+{
+}
+
+void FlightRecorder::setup()
+{
+#if defined(ARDUINO_ARCH_ESP8266)
+    ESP.rtcUserMemoryRead(
+        RTC_OFFSET, reinterpret_cast<uint32_t*>(&s_storage), sizeof(s_storage));
+#endif
+    if (s_storage.magic != FLIGHTRECORDER_MAGIC ||
+            s_storage.head >= NUM_ENTRIES || s_storage.count > NUM_ENTRIES) {
+        // Cold boot (or garbage): start with a clean slate.
+        memset(&s_storage, 0, sizeof(s_storage));
+        s_storage.magic = FLIGHTRECORDER_MAGIC;
+#if defined(ARDUINO_ARCH_ESP8266)
+        ESP.rtcUserMemoryWrite(
+            RTC_OFFSET, reinterpret_cast<uint32_t*>(&s_storage), sizeof(s_storage));
+#endif
+    }
+    s_storage.bootcount += 1;
+    record(EV_BOOT, get_reset_reason(), s_storage.bootcount);
+}
+
+void FlightRecorder::record(enum event type, uint8_t a, uint16_t b)
+{
+    MutexLock lock(m_mutex);
+    uint8_t idx = s_storage.head;
+    Entry& entry = s_storage.entries[idx];
+    entry.ms = millis();
+    entry.type = type;
+    entry.a = a;
+    entry.b = b;
+    s_storage.head = (idx + 1) % NUM_ENTRIES;
+    if (s_storage.count < NUM_ENTRIES) {
+        s_storage.count += 1;
+    }
+    sync_entry(idx);
+    sync_header();
+}
+
+String FlightRecorder::to_formdata() const
+{
+    // "boot=<n>&events=<hex>" where each event is 16 hex digits:
+    // ms(8) type(2) a(2) b(4), oldest first.
+    static const char hexdigits[] PROGMEM = "0123456789abcdef";
+    MutexLock lock(m_mutex);
+    String ret;
+    ret.reserve(20 + s_storage.count * 16);
+    ret += F("boot=");
+    ret += s_storage.bootcount;
+    ret += F("&events=");
+    uint8_t idx = (s_storage.head + NUM_ENTRIES - s_storage.count) % NUM_ENTRIES;
+    for (uint8_t i = 0; i < s_storage.count; ++i) {
+        const Entry& entry = s_storage.entries[(idx + i) % NUM_ENTRIES];
+        uint32_t words[3] = {
+            entry.ms, static_cast<uint32_t>(entry.type << 8U | entry.a), entry.b};
+        uint8_t digits[3] = {8, 4, 4};
+        for (uint8_t w = 0; w < 3; ++w) {
+            for (int8_t d = digits[w] - 1; d >= 0; --d) {
+                ret += static_cast<char>(
+                    pgm_read_byte(&hexdigits[(words[w] >> (d * 4)) & 0xf]));
+            }
+        }
+    }
+    return ret;
+}
+
+void FlightRecorder::mark_published()
+{
+    m_published = true;
+    record(EV_PUBLISHED, 0, s_storage.count);
+}
+
+void FlightRecorder::dump(Print& out) const
+{
+    // Fixed width names, so the whole table lives in flash.
+    static const char names[][10] PROGMEM = {
+        "none", "boot", "wifi", "ccs811", "mqtt", "http", "stall", "published",
+        "roam"};
+    out << F("FlightRecorder: boot ") << s_storage.bootcount <<  // (idefix)
+        F(", ") << s_storage.count << F(" events\r\n");
+    uint8_t idx = (s_storage.head + NUM_ENTRIES - s_storage.count) % NUM_ENTRIES;
+    for (uint8_t i = 0; i < s_storage.count; ++i) {
+        const Entry& entry = s_storage.entries[(idx + i) % NUM_ENTRIES];
+        out << F("  ") << entry.ms << F(" ms: ") <<  // (idefix)
+            (entry.type <= EV_ROAM ?
+             reinterpret_cast<const __FlashStringHelper*>(names[entry.type]) : F("?")) <<
+            F(" ") << entry.a << F(" ") << static_cast<int16_t>(entry.b) << F("\r\n");
+    }
+}
+
+#ifdef TEST_BUILD
+bool FlightRecorder::load_formdata(const char* formdata)
+{
+    // Parse the output of to_formdata() back into the storage, so we can
+    // dump() what a device published.
+    const char* boot = strstr(formdata, "boot=");
+    const char* events = strstr(formdata, "events=");
+    if (!boot || !events) {
+        return false;
+    }
+    memset(&s_storage, 0, sizeof(s_storage));
+    s_storage.magic = FLIGHTRECORDER_MAGIC;
+    s_storage.bootcount = strtoul(boot + 5, NULL, 10);
+    events += 7;
+    while (s_storage.count < NUM_ENTRIES && strspn(events, "0123456789abcdefABCDEF") >= 16) {
+        char buf[9];
+        Entry& entry = s_storage.entries[s_storage.count];
+        memcpy(buf, events, 8); buf[8] = '\0';
+        entry.ms = strtoul(buf, NULL, 16);
+        memcpy(buf, events + 8, 2); buf[2] = '\0';
+        entry.type = strtoul(buf, NULL, 16);
+        memcpy(buf, events + 10, 2); buf[2] = '\0';
+        entry.a = strtoul(buf, NULL, 16);
+        memcpy(buf, events + 12, 4); buf[4] = '\0';
+        entry.b = strtoul(buf, NULL, 16);
+        s_storage.count += 1;
+        events += 16;
+    }
+    s_storage.head = s_storage.count % NUM_ENTRIES;
+    return true;
+}
+#endif
+
+void FlightRecorder::sync_header()
+{
+#if defined(ARDUINO_ARCH_ESP8266)
+    ESP.rtcUserMemoryWrite(RTC_OFFSET, reinterpret_cast<uint32_t*>(&s_storage), 8);
+#endif
+}
+
+void FlightRecorder::sync_entry(uint8_t idx)
+{
+#if defined(ARDUINO_ARCH_ESP8266)
+    ESP.rtcUserMemoryWrite(
+        RTC_OFFSET + 2 + idx * (sizeof(Entry) / 4),
+        reinterpret_cast<uint32_t*>(&s_storage.entries[idx]), sizeof(Entry));
+#else
+    (void)idx;
+#endif
+}
+
+uint8_t FlightRecorder::get_reset_reason()
+{
+#if defined(ARDUINO_ARCH_ESP8266)
+    // REASON_DEFAULT_RST(0), WDT(1), EXCEPTION(2), SOFT_WDT(3),
+    // SOFT_RESTART(4), DEEP_SLEEP_AWAKE(5), EXT_SYS_RST(6)
+    return ESP.getResetInfoPtr()->reason;
+#elif defined(ARDUINO_ARCH_ESP32)
+    return static_cast<uint8_t>(esp_reset_reason());
+#else
+    return 0;
+#endif
+}
@@ -0,0 +1,76 @@
+#ifndef INCLUDED_PE32HUD_FLIGHTRECORDER_H
+#define INCLUDED_PE32HUD_FLIGHTRECORDER_H
+
+#include "pe32hud.h"
+
+/* The FlightRecorder keeps the last few device events in memory that
+ * survives a (watchdog/exception) reset: RTC user memory on the ESP8266
+ * and RTC_NOINIT memory on the ESP32. After boot, the previous history
+ * is published once through MQTT so we can see why a unit rebooted.
+ *
+ * Recording an event is a handful of stores (and an 8 byte RTC write on
+ * the ESP8266), so it is left enabled in production. */
+class FlightRecorder {
+public:
+    enum event {
+        EV_NONE = 0,
+        EV_BOOT = 1,            // a=reset reason, b=boot count
+        EV_WIFI_STATE = 2,      // a=old wl_status_t, b=new wl_status_t
+        EV_CCS811_STATE = 3,    // a=old state, b=new state
+        EV_MQTT_CONNECT = 4,    // a=1 on success, b=attempts or connectError()
+        EV_HTTP_CODE = 5,       // a=HUD source, b=HTTP status (or negative error)
+        EV_LOOP_STALL = 6,      // b=loop() duration in ms (saturated)
+        EV_PUBLISHED = 7,       // b=number of events published
+        EV_ROAM = 8             // a=-RSSI (old AP, smoothed), b=-RSSI (new AP)
+    };
+
+    struct Entry {
+        uint32_t ms;
+        uint8_t type;
+        uint8_t a;
+        uint16_t b;
+    };  // 8 bytes; keep it 4-byte aligned for the RTC memory
+
+    // 8 bytes header + 40 * 8 bytes events = 328 bytes. The ESP8266 has
+    // 512 bytes of RTC user memory, of which the first 128 are used by
+    // the OTA updater (eboot command).
+    static constexpr uint8_t NUM_ENTRIES = 40;
+    static constexpr unsigned long STALL_MS = 250;
+
+private:
+    struct Storage {
+        uint32_t magic;
+        uint16_t bootcount;
+        uint8_t head;   // next slot to write
+        uint8_t count;  // number of valid slots
+        Entry entries[NUM_ENTRIES];
+    };
+
+    static Storage s_storage;
+    bool m_published;
+    mutable Mutex m_mutex;      // both cores record (HAVE_DUALCORE)
+
+public:
+    FlightRecorder();
+
+    void setup();
+
+    void record(enum event type, uint8_t a = 0, uint16_t b = 0);
+
+    uint16_t get_bootcount() const { return s_storage.bootcount; }
+    bool has_unpublished() const { return !m_published; }
+    String to_formdata() const;
+    void mark_published();
+
+    void dump(Print& out) const;
+#ifdef TEST_BUILD
+    bool load_formdata(const char* formdata);
+#endif
+
+private:
+    void sync_header();
+    void sync_entry(uint8_t idx);
+    static uint8_t get_reset_reason();
+};
+
+#endif //INCLUDED_PE32HUD_FLIGHTRECORDER_H
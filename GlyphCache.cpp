@@ -0,0 +1,68 @@
+#include "GlyphCache.h"
+
+GlyphCache::GlyphCache() :
+    m_tick(0),
+    m_valid(0),
+    m_dirty(0),
+    m_keep(0),
+    m_line(0),
+    m_hits(0),
+    m_writes(0)
+{
+}
+
+char GlyphCache::get(const uint8_t rows[ROWS], char fallback)
+{
+    uint16_t h = hash(rows);
+    uint8_t victim = NUM_SLOTS;
+    uint16_t oldest = 0;
+
+    m_tick += 1;
+    for (uint8_t slot = 0; slot < NUM_SLOTS; ++slot) {
+        Slot& s = m_slots[slot];
+        if ((m_valid & (1 << slot)) && s.hash == h && memcmp(s.rows, rows, ROWS) == 0) {
+            s.used = m_tick;
+            m_line |= (1 << slot);
+            m_hits += 1;
+            return FIRST_CHAR + slot;
+        }
+        if ((m_keep | m_line) & (1 << slot)) {
+            continue;  // on screen, or already used by this line
+        }
+        // Empty slots first, then the least recently used one. The
+        // distance in ticks survives the wrap of m_tick.
+        uint16_t age = (m_valid & (1 << slot)) ? m_tick - s.used : 0xffff;
+        if (victim == NUM_SLOTS || age > oldest) {
+            victim = slot;
+            oldest = age;
+        }
+    }
+    if (victim == NUM_SLOTS) {
+        return fallback;
+    }
+    Slot& s = m_slots[victim];
+    memcpy(s.rows, rows, ROWS);
+    s.hash = h;
+    s.used = m_tick;
+    m_valid |= (1 << victim);
+    m_dirty |= (1 << victim);
+    m_line |= (1 << victim);
+    return FIRST_CHAR + victim;
+}
+
+void GlyphCache::take(uint8_t slot, uint8_t rows[ROWS])
+{
+    memcpy(rows, m_slots[slot].rows, ROWS);
+    m_dirty &= ~(1 << slot);
+    m_writes += 1;
+}
+
+uint16_t GlyphCache::hash(const uint8_t rows[ROWS])
+{
+    // FNV-1a, folded to 16 bits.
+    uint32_t h = 2166136261U;
+    for (uint8_t i = 0; i < ROWS; ++i) {
+        h = (h ^ rows[i]) * 16777619U;
+    }
+    return static_cast<uint16_t>(h ^ (h >> 16));
+}
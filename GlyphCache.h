@@ -0,0 +1,61 @@
+#ifndef INCLUDED_PE32HUD_GLYPHCACHE_H
+#define INCLUDED_PE32HUD_GLYPHCACHE_H
+
+#include "pe32hud.h"
+
+/* The HD44780 has 8 programmable (CGRAM) characters. The GlyphCache
+ * hands them out to the 5x8 bitmaps a HUD line asks for (sparkline
+ * columns, trend arrows), least recently used first.
+ *
+ * A bitmap that is already in a slot (same hash, same rows) reuses it,
+ * so a redraw only costs CGRAM writes (11 bytes of I2C per glyph) for
+ * content that actually changed. Slots shown on the other rows are
+ * never evicted; when none is left, get() returns the fallback.
+ *
+ * The characters are 8..15, the mirror of CGRAM 0..7, so they never
+ * end a String. */
+class GlyphCache {
+public:
+    static constexpr uint8_t NUM_SLOTS = 8;
+    static constexpr char FIRST_CHAR = 8;
+    static constexpr uint8_t ROWS = 8;          // one byte per row, 5 bits
+
+private:
+    struct Slot {
+        uint8_t rows[ROWS];
+        uint16_t hash;
+        uint16_t used;          // m_tick at the last get()
+    };
+
+    Slot m_slots[NUM_SLOTS];
+    uint16_t m_tick;
+    uint8_t m_valid;            // bitmask of slots with content
+    uint8_t m_dirty;            // content not in CGRAM yet
+    uint8_t m_keep;             // slots in use elsewhere (see begin())
+    uint8_t m_line;             // slots used by the line being rendered
+    uint32_t m_hits;
+    uint32_t m_writes;
+
+public:
+    GlyphCache();
+
+    // Start rendering a line. Slots in keep are on screen elsewhere and
+    // stay as they are.
+    void begin(uint8_t keep) { m_keep = keep; m_line = 0; }
+    // The character for the bitmap, or fallback if all slots are taken.
+    char get(const uint8_t rows[ROWS], char fallback);
+    // The slots the line rendered since begin() uses.
+    uint8_t get_line() const { return m_line; }
+
+    // Slots to (re)write; take() clears the bit and copies the rows.
+    uint8_t get_dirty() const { return m_dirty; }
+    void take(uint8_t slot, uint8_t rows[ROWS]);
+
+    uint32_t get_hits() const { return m_hits; }
+    uint32_t get_writes() const { return m_writes; }
+
+private:
+    static uint16_t hash(const uint8_t rows[ROWS]);
+};
+
+#endif //INCLUDED_PE32HUD_GLYPHCACHE_H
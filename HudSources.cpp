@@ -0,0 +1,92 @@
+#include "HudSources.h"
+
+bool HudSources::add(const __FlashStringHelper* url)
+{
+    if (m_nsources >= MAX_SOURCES) {
+        return false;
+    }
+    Source& src = m_sources[m_nsources++];
+    src.url = url;
+    src.quality.reset();
+    src.usedat = 0;
+    src.failures = 0;
+    src.failedat = 0;
+    src.backoff = 0;
+    src.errors = 0;
+    return true;
+}
+
+uint8_t HudSources::order(uint8_t idxs[MAX_SOURCES]) const
+{
+    // Insertion sort on a list of at most MAX_SOURCES; ties keep the
+    // configured order.
+    uint8_t n = 0;
+    for (uint8_t idx = 0; idx < m_nsources; ++idx) {
+        if (is_backed_off(idx)) {
+            continue;
+        }
+        uint8_t pos = n++;
+        while (pos && is_faster(idx, idxs[pos - 1])) {
+            idxs[pos] = idxs[pos - 1];
+            --pos;
+        }
+        idxs[pos] = idx;
+    }
+    if (!n && m_nsources) {
+        // Never poll nothing: the one that is back soonest.
+        unsigned long soonest = 0;
+        for (uint8_t idx = 0; idx < m_nsources; ++idx) {
+            const Source& src = m_sources[idx];
+            unsigned long left = src.backoff - (millis() - src.failedat);
+            if (!n || left < soonest) {
+                idxs[0] = idx;
+                soonest = left;
+                n = 1;
+            }
+        }
+    }
+    return n;
+}
+
+void HudSources::add_success(uint8_t idx, unsigned long ms)
+{
+    Source& src = m_sources[idx];
+    src.quality.add_latency(ms);
+    src.usedat = millis();
+    src.failures = 0;
+    src.backoff = 0;
+}
+
+void HudSources::add_failure(uint8_t idx)
+{
+    Source& src = m_sources[idx];
+    unsigned long wait = BACKOFF_MAX;
+    if (src.failures < 16 && (BACKOFF_MIN << src.failures) < BACKOFF_MAX) {
+        wait = BACKOFF_MIN << src.failures;
+    }
+    if (src.failures < 0xff) {
+        src.failures += 1;
+    }
+    src.errors += 1;
+    src.failedat = millis();
+    src.backoff = wait;
+}
+
+bool HudSources::is_backed_off(uint8_t idx) const
+{
+    const Source& src = m_sources[idx];
+    return src.backoff && (millis() - src.failedat) < src.backoff;
+}
+
+bool HudSources::has_latency(uint8_t idx) const
+{
+    const Source& src = m_sources[idx];
+    return src.quality.get_latency_samples() && (millis() - src.usedat) < LATENCY_TTL;
+}
+
+bool HudSources::is_faster(uint8_t idx, uint8_t than) const
+{
+    // Without recent samples for both, there is nothing to compare.
+    return has_latency(idx) && has_latency(than) &&
+        get_latency(idx) + LATENCY_MARGIN < get_latency(than);
+}
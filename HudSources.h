@@ -0,0 +1,73 @@
+#ifndef INCLUDED_PE32HUD_HUDSOURCES_H
+#define INCLUDED_PE32HUD_HUDSOURCES_H
+
+#include "pe32hud.h"
+
+#include "LinkQuality.h"
+
+/* The HUD servers to poll, in order of preference (SECRET_HUD_URL, then
+ * the optional SECRET_HUD_URL2), with the health of each.
+ *
+ * Each fetch gets FETCH_BUDGET for the connect and for each read; a
+ * poll tries the sources that order() returns until one answers. That
+ * bounds a poll to about MAX_SOURCES budgets, except for the DNS lookup
+ * before each connect: HTTPClient does not pass the budget on, and the
+ * cores resolve with their own (long, or no) timeout. So a poll with a
+ * dead DNS server can take far longer.
+ *
+ * A source that fails is skipped for a backoff that doubles with each
+ * consecutive failure; but when all of them back off, the one whose
+ * backoff ends first is still tried, so a single source is polled as
+ * often as before. A later source goes first only when its average
+ * latency beats the earlier one by LATENCY_MARGIN, so the primary keeps
+ * the traffic unless it is clearly slower. An average older than
+ * LATENCY_TTL does not count, so the primary gets another try every so
+ * often.
+ *
+ * When no source answers, the last good payload (the "local cache")
+ * stays on screen, marked stale; see NetworkComponent::sample(). */
+class HudSources {
+public:
+    static constexpr uint8_t MAX_SOURCES = 2;
+    static constexpr uint16_t FETCH_BUDGET = 1500;          // ms
+    static constexpr unsigned long BACKOFF_MIN = 15000;     // 3 polls
+    static constexpr unsigned long BACKOFF_MAX = 300000;    // 5min
+    static constexpr unsigned long LATENCY_MARGIN = 250;    // ms
+    static constexpr unsigned long LATENCY_TTL = 60000;     // 1min
+
+private:
+    struct Source {
+        const __FlashStringHelper* url;
+        LinkQuality quality;    // only the latency is used
+        unsigned long usedat;   // last success
+        uint8_t failures;       // consecutive, for the backoff
+        unsigned long failedat;
+        unsigned long backoff;  // 0 when healthy
+        uint32_t errors;        // all time
+    };
+
+    Source m_sources[MAX_SOURCES];
+    uint8_t m_nsources;
+
+public:
+    HudSources() : m_nsources(0) {}
+
+    bool add(const __FlashStringHelper* url);
+    uint8_t size() const { return m_nsources; }
+    const __FlashStringHelper* get_url(uint8_t idx) const { return m_sources[idx].url; }
+
+    // The sources to try this poll, best first. Returns how many.
+    uint8_t order(uint8_t idxs[MAX_SOURCES]) const;
+    void add_success(uint8_t idx, unsigned long ms);
+    void add_failure(uint8_t idx);
+
+    bool is_backed_off(uint8_t idx) const;
+    unsigned long get_latency(uint8_t idx) const { return m_sources[idx].quality.get_latency(); }
+    uint32_t get_errors(uint8_t idx) const { return m_sources[idx].errors; }
+
+private:
+    bool has_latency(uint8_t idx) const;
+    bool is_faster(uint8_t idx, uint8_t than) const;
+};
+
+#endif //INCLUDED_PE32HUD_HUDSOURCES_H
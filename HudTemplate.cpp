@@ -0,0 +1,153 @@
+#include "HudTemplate.h"
+
+#include "DisplayComponent.h"   // LCD_COLS
+
+extern Device Device;
+
+void HudTemplate::compile(const String& source)
+{
+    uint8_t pc = 0;
+    uint8_t literal = PROGRAM_SIZE;  // pc of the open literal, if any
+    m_uses = 0;
+    m_useshistory = 0;
+
+    // Always leave room for the OP_END; a line that does not fit is cut.
+    for (const char* p = source.c_str(); *p; ) {
+        uint8_t op;
+        const char* next;
+        if (*p == '{' && (next = parse_placeholder(p, op))) {
+            if (pc + 1 >= PROGRAM_SIZE) {
+                break;
+            }
+            m_program[pc++] = op;
+            if ((op & OP_GLYPH) == OP_GLYPH) {
+                m_useshistory |= 1 << ((op >> 3) & 0x7);
+            } else {
+                m_uses |= 1 << ((op >> 3) & 0x7);
+            }
+            literal = PROGRAM_SIZE;
+            p = next;
+            continue;
+        }
+        if (literal == PROGRAM_SIZE || m_program[literal] == OP_LITERAL_MAX) {
+            if (pc + 2 >= PROGRAM_SIZE) {
+                break;
+            }
+            literal = pc;
+            m_program[pc++] = 0;
+        } else if (pc + 1 >= PROGRAM_SIZE) {
+            break;
+        }
+        m_program[pc++] = *p++;
+        m_program[literal] += 1;
+    }
+    m_program[pc] = OP_END;
+}
+
+void HudTemplate::render(String& out, GlyphCache& glyphs) const
+{
+    out = String();
+    out.reserve(LCD_COLS);
+    uint8_t pc = 0;
+    while (m_program[pc] != OP_END) {
+        uint8_t op = m_program[pc++];
+        if ((op & OP_GLYPH) == OP_GLYPH) {
+            render_glyph(out, glyphs, op);
+        } else if (op & OP_READING) {
+            float value;
+            if (Device.get_reading(static_cast<enum Device::reading>((op >> 3) & 0x7), value)) {
+                out += String(value, static_cast<unsigned char>(op & 0x7));
+            } else {
+                out += '?';
+            }
+        } else {
+            for (uint8_t i = 0; i < op; ++i) {
+                out += static_cast<char>(m_program[pc++]);
+            }
+        }
+    }
+}
+
+void HudTemplate::render_glyph(String& out, GlyphCache& glyphs, uint8_t op)
+{
+    static const uint8_t arrows[3][GlyphCache::ROWS] PROGMEM = {
+        {0x04, 0x0e, 0x15, 0x04, 0x04, 0x04, 0x04, 0x00},    // up
+        {0x00, 0x04, 0x02, 0x1f, 0x02, 0x04, 0x00, 0x00},    // same
+        {0x04, 0x04, 0x04, 0x04, 0x15, 0x0e, 0x04, 0x00}};   // down
+    float values[Device::HISTORY_SIZE];
+    uint8_t len = Device.get_history(static_cast<enum Device::reading>((op >> 3) & 0x7), values);
+    uint8_t rows[GlyphCache::ROWS];
+
+    if (!len) {
+        out += '?';
+        return;
+    }
+    if ((op & 0x7) == GLYPH_TREND) {
+        uint8_t arrow = 1;
+        if (len >= 2 && values[len - 1] != values[len - 2]) {
+            arrow = (values[len - 1] > values[len - 2] ? 0 : 2);
+        }
+        memcpy_P(rows, arrows[arrow], sizeof(rows));
+        out += glyphs.get(rows, '=');
+        return;
+    }
+
+    // GLYPH_SPARK: one column per sample, newest on the right, as a bar
+    // of 1..8 pixels scaled between the lowest and highest sample. A
+    // flat line stays low.
+    float lo = values[0], hi = values[0];
+    for (uint8_t i = 1; i < len; ++i) {
+        lo = (values[i] < lo ? values[i] : lo);
+        hi = (values[i] > hi ? values[i] : hi);
+    }
+    uint8_t skip = Device::HISTORY_SIZE - len;  // empty columns on the left
+    for (uint8_t cell = 0; cell < SPARK_CELLS; ++cell) {
+        memset(rows, 0, sizeof(rows));
+        for (uint8_t col = 0; col < 5; ++col) {
+            uint8_t x = cell * 5 + col;
+            if (x < skip) {
+                continue;
+            }
+            uint8_t height = 1;
+            if (hi > lo) {
+                height += static_cast<uint8_t>((values[x - skip] - lo) * 7 / (hi - lo) + 0.5f);
+            }
+            for (uint8_t row = GlyphCache::ROWS - height; row < GlyphCache::ROWS; ++row) {
+                rows[row] |= (0x10 >> col);
+            }
+        }
+        out += glyphs.get(rows, '#');
+    }
+}
+
+const char* HudTemplate::parse_placeholder(const char* p, uint8_t& op)
+{
+    // Same order as Device::reading; fixed width so it stays in flash.
+    static const char names[][9] PROGMEM = {
+        "eco2", "tvoc", "temp", "humidity", "rssi"};
+    const char* close = strchr(p, '}');
+    if (!close) {
+        return NULL;
+    }
+    const char* colon = static_cast<const char*>(memchr(p, ':', close - p));
+    size_t namelen = (colon ? colon : close) - (p + 1);
+    uint8_t kind = OP_READING;
+    uint8_t arg = 0;    // decimals, or the glyph
+    if (colon && close - colon == 2 && (colon[1] == '~' || colon[1] == '^')) {
+        kind = OP_GLYPH;
+        arg = (colon[1] == '~' ? GLYPH_SPARK : GLYPH_TREND);
+    } else if (colon) {
+        if (close - colon != 3 || colon[1] != '.' || colon[2] < '0' || colon[2] > '7') {
+            return NULL;
+        }
+        arg = colon[2] - '0';
+    }
+    for (uint8_t rd = 0; rd < Device::NUM_READINGS; ++rd) {
+        if (namelen < sizeof(names[rd]) && strncmp_P(p + 1, names[rd], namelen) == 0 &&
+                pgm_read_byte(&names[rd][namelen]) == '\0') {
+            op = kind | rd << 3 | arg;
+            return close + 1;
+        }
+    }
+    return NULL;
+}
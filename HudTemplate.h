@@ -0,0 +1,62 @@
+#ifndef INCLUDED_PE32HUD_HUDTEMPLATE_H
+#define INCLUDED_PE32HUD_HUDTEMPLATE_H
+
+#include "pe32hud.h"
+
+#include "Device.h"
+#include "GlyphCache.h"
+
+/* A HUD line with placeholders for local readings:
+ *
+ *   "CO2 {eco2} {temp:.1}C"  ->  "CO2 612 21.4C"
+ *
+ * Names are those of Device::reading (eco2, tvoc, temp, humidity,
+ * rssi); ":.N" selects N decimals (default 0). ":~" draws the last
+ * Device::HISTORY_SIZE samples as a sparkline of bars (SPARK_CELLS
+ * custom characters) and ":^" an arrow for the last change; those come
+ * from the GlyphCache. Anything else between braces is kept as text. A
+ * reading we don't have yet renders as "?".
+ *
+ * compile() turns the line into a small byte program once, so render()
+ * does not parse again on every sensor update:
+ *
+ *   0x00               end
+ *   0x01..0x7f N       N literal characters follow
+ *   0x80 | rd<<3 | d   reading rd with d decimals
+ *   0xc0 | rd<<3 | g   reading rd as glyph g (GLYPH_SPARK, GLYPH_TREND) */
+class HudTemplate {
+public:
+    static constexpr uint8_t PROGRAM_SIZE = 40;
+    static constexpr uint8_t SPARK_CELLS = Device::HISTORY_SIZE / 5;
+
+private:
+    enum {
+        OP_END = 0x00,
+        OP_LITERAL_MAX = 0x7f,
+        OP_READING = 0x80,
+        OP_GLYPH = 0xc0
+    };
+    enum {
+        GLYPH_SPARK = 0,
+        GLYPH_TREND = 1
+    };
+
+    uint8_t m_program[PROGRAM_SIZE];
+    uint8_t m_uses;     // bitmask of (1 << Device::reading)
+    uint8_t m_useshistory;
+
+public:
+    HudTemplate() : m_uses(0), m_useshistory(0) { m_program[0] = OP_END; }
+
+    void compile(const String& source);
+    void render(String& out, GlyphCache& glyphs) const;
+
+    bool uses(uint8_t readings) const { return m_uses & readings; }
+    bool uses_history(uint8_t readings) const { return m_useshistory & readings; }
+
+private:
+    static const char* parse_placeholder(const char* p, uint8_t& op);
+    static void render_glyph(String& out, GlyphCache& glyphs, uint8_t op);
+};
+
+#endif //INCLUDED_PE32HUD_HUDTEMPLATE_H
@@ -0,0 +1,185 @@
+#include "I2CBus.h"
+
+#include "I2CTrace.h"
+
+I2CDevice* I2CBus::s_holder;
+
+I2CBus::I2CBus(TwoWire* theWire) :
+    m_wire(theWire),
+    m_njobs(0),
+    m_ndevices(0),
+    m_clock(0),
+    m_current(NULL),
+    m_acquired(0)
+{
+}
+
+void I2CBus::begin(int sda, int scl)
+{
+#if defined(ARDUINO_ARCH_ESP32) || defined(ARDUINO_ARCH_ESP8266)
+    m_wire->begin(sda, scl);  // non-standard ESP invocation
+#else
+    (void)sda;
+    (void)scl;
+    m_wire->begin();  // fixed I2C pins on the Arduino
+#endif
+}
+
+void I2CBus::begin()
+{
+    m_wire->begin();
+}
+
+void I2CBus::loop()
+{
+    if (!m_njobs) {
+        return;
+    }
+    uint8_t best = 0;
+    for (uint8_t i = 1; i < m_njobs; ++i) {
+        if (m_jobs[i].prio > m_jobs[best].prio) {
+            best = i;
+        }
+    }
+    Job job = m_jobs[best];
+    // Keep FIFO order for the remaining jobs.
+    for (uint8_t i = best + 1; i < m_njobs; ++i) {
+        m_jobs[i - 1] = m_jobs[i];
+    }
+    m_njobs -= 1;
+
+    acquire(*job.dev);
+    job.fn(job.ctx);
+    release();
+}
+
+bool I2CBus::enqueue(I2CDevice& dev, job_fn fn, void* ctx, enum priority prio)
+{
+    if (is_pending(fn, ctx)) {
+        return true;  // coalesce; it will see the latest state anyway
+    }
+    if (m_njobs == MAX_JOBS) {
+        LOG_WARN(I2C) << F("I2CBus: queue full, dropping job for ") << dev.name << F("\r\n");
+        dev.errors += 1;
+        return false;
+    }
+    Job& job = m_jobs[m_njobs++];
+    job.dev = &dev;
+    job.fn = fn;
+    job.ctx = ctx;
+    job.prio = prio;
+    return true;
+}
+
+bool I2CBus::is_pending(job_fn fn, void* ctx) const
+{
+    for (uint8_t i = 0; i < m_njobs; ++i) {
+        if (m_jobs[i].fn == fn && m_jobs[i].ctx == ctx) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void I2CBus::acquire(I2CDevice& dev)
+{
+    if (m_clock != dev.clock) {
+        m_wire->setClock(dev.clock);
+        m_clock = dev.clock;
+    }
+#if defined(ARDUINO_ARCH_ESP8266)
+    // The CCS811 stretches the clock well beyond the 230us default.
+    m_wire->setClockStretchLimit(dev.stretch_us ? dev.stretch_us : 230);
+#endif
+    m_current = &dev;
+    s_holder = &dev;
+    m_acquired = micros();
+
+    uint8_t i;
+    for (i = 0; i < m_ndevices && m_devices[i] != &dev; ++i) {
+    }
+    if (i == m_ndevices && m_ndevices < MAX_DEVICES) {
+        m_devices[m_ndevices++] = &dev;
+    }
+}
+
+void I2CBus::release()
+{
+    if (!m_current) {
+        return;
+    }
+    uint32_t elapsed = micros() - m_acquired;
+    m_current->transactions += 1;
+    m_current->busy_us += elapsed;
+    if (elapsed > m_current->max_us) {
+        m_current->max_us = elapsed;
+    }
+    m_current = NULL;
+    s_holder = NULL;
+}
+
+bool I2CBus::write(I2CDevice& dev, const uint8_t* buf, uint8_t len)
+{
+    m_wire->beginTransmission(dev.addr);
+    m_wire->write(buf, len);
+#ifndef I2C_WIRE_HOOKS
+    dev.bytes_written += len;
+#endif
+    uint8_t err = m_wire->endTransmission();
+    trace(false, dev.addr, buf, len, err);
+    if (err) {
+        dev.errors += 1;
+        return false;
+    }
+    return true;
+}
+
+bool I2CBus::read(I2CDevice& dev, uint8_t reg, uint8_t* buf, uint8_t len)
+{
+    if (!write(dev, &reg, 1)) {
+        return false;
+    }
+    if (m_wire->requestFrom(dev.addr, len) != len) {
+        trace(true, dev.addr, buf, 0, 4);  // "other error"
+        dev.errors += 1;
+        return false;
+    }
+    for (uint8_t i = 0; i < len; ++i) {
+        buf[i] = m_wire->read();
+    }
+#ifndef I2C_WIRE_HOOKS
+    dev.bytes_read += len;
+#endif
+    trace(true, dev.addr, buf, len, 0);
+    return true;
+}
+
+void I2CBus::count(uint16_t written, uint16_t read)
+{
+    if (s_holder) {
+        s_holder->bytes_written += written;
+        s_holder->bytes_read += read;
+    }
+}
+
+void I2CBus::dump_stats(Print& out) const
+{
+    for (uint8_t i = 0; i < m_ndevices; ++i) {
+        const I2CDevice& dev = *m_devices[i];
+        out << F("I2CBus: ") << dev.name << F(" @ 0x") <<  // (idefix)
+            String(dev.addr, HEX) << F(": ") << dev.transactions << F(" trans, ") <<  // (idefix)
+            dev.bytes_written << F(" written, ") << dev.bytes_read << F(" read, ") <<  // (idefix)
+            dev.errors << F(" errors, ") << dev.busy_us << F(" us busy, ") <<  // (idefix)
+            dev.max_us << F(" us max\r\n");
+    }
+}
+
+void I2CBus::trace(bool is_read, uint8_t addr, const uint8_t* buf, uint8_t len, uint8_t err)
+{
+#if defined(I2C_TRACE_RECORD) && defined(I2C_WIRE_HOOKS)
+    // The twi_* hooks see this traffic already.
+    (void)is_read; (void)addr; (void)buf; (void)len; (void)err;
+#else
+    i2c_trace(is_read, addr, buf, len, err);
+#endif
+}
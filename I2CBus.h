@@ -0,0 +1,96 @@
+#ifndef INCLUDED_PE32HUD_I2CBUS_H
+#define INCLUDED_PE32HUD_I2CBUS_H
+
+#include "pe32hud.h"
+
+/* A device on the I2C bus, with its own clock settings and counters. */
+struct I2CDevice {
+    const __FlashStringHelper* const name;
+    const uint8_t addr;
+    const uint32_t clock;       // Hz; 100000 or 400000
+    const uint16_t stretch_us;  // ESP8266 clock stretch limit, 0=default
+
+    uint32_t transactions;
+    uint32_t bytes_written;
+    uint32_t bytes_read;
+    uint32_t errors;
+    uint32_t busy_us;           // total time we held the bus
+    uint32_t max_us;            // longest single hold
+
+    I2CDevice(const __FlashStringHelper* name_, uint8_t addr_, uint32_t clock_, uint16_t stretch_us_ = 0)
+        : name(name_), addr(addr_), clock(clock_), stretch_us(stretch_us_),
+          transactions(0), bytes_written(0), bytes_read(0), errors(0),
+          busy_us(0), max_us(0) {}
+};
+
+/* The I2CBus owns the TwoWire and serializes access to it.
+ *
+ * Components enqueue() jobs with a priority; loop() runs at most one
+ * job per pass, highest priority first (FIFO within a priority). That
+ * way a sensor read waits for at most one (small) display job instead
+ * of a full redraw. The bus is switched to the device clock before the
+ * job runs.
+ *
+ * Jobs either use the raw write()/read() helpers, which (with
+ * LOG_LEVEL_I2C at DEBUG) log an I2CWRITE/I2CREAD trace (see
+ * I2CTrace.h), or they call a driver library on get_wire(). The bytes
+ * are counted at the Wire layer by the twi hooks, for the device that
+ * holds the bus; without the hooks only those of write()/read(). */
+class I2CBus {
+public:
+    enum priority {
+        PRIO_LOW = 0,       // display updates
+        PRIO_NORMAL = 1,
+        PRIO_HIGH = 2       // sensor samples
+    };
+    typedef void (*job_fn)(void* ctx);
+
+private:
+    struct Job {
+        I2CDevice* dev;
+        job_fn fn;
+        void* ctx;
+        uint8_t prio;
+    };
+    static constexpr uint8_t MAX_JOBS = 8;
+    static constexpr uint8_t MAX_DEVICES = 4;
+
+    TwoWire* m_wire;
+    Job m_jobs[MAX_JOBS];
+    uint8_t m_njobs;
+    I2CDevice* m_devices[MAX_DEVICES];  // for dump_stats()
+    uint8_t m_ndevices;
+    uint32_t m_clock;
+    I2CDevice* m_current;
+    unsigned long m_acquired;
+    static I2CDevice* s_holder;     // m_current, for count()
+
+public:
+    I2CBus(TwoWire* theWire = &Wire);
+
+    void begin(int sda, int scl);
+    void begin();
+
+    void loop();
+
+    bool enqueue(I2CDevice& dev, job_fn fn, void* ctx, enum priority prio);
+    bool is_pending(job_fn fn, void* ctx) const;
+
+    // Synchronous access, for things that cannot wait for a loop().
+    void acquire(I2CDevice& dev);
+    void release();
+    TwoWire* get_wire() { return m_wire; }
+
+    bool write(I2CDevice& dev, const uint8_t* buf, uint8_t len);
+    bool read(I2CDevice& dev, uint8_t reg, uint8_t* buf, uint8_t len);
+
+    // Bytes that went over the wire (from the twi hooks).
+    static void count(uint16_t written, uint16_t read);
+
+    void dump_stats(Print& out) const;
+
+private:
+    void trace(bool is_read, uint8_t addr, const uint8_t* buf, uint8_t len, uint8_t err);
+};
+
+#endif //INCLUDED_PE32HUD_I2CBUS_H
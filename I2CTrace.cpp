@@ -0,0 +1,58 @@
+#include "I2CTrace.h"
+
+#include "I2CBus.h"
+
+void i2c_trace(bool is_read, uint8_t addr, const uint8_t* buf, size_t len, uint8_t err)
+{
+#ifndef I2C_TRACE_RECORD
+    // (When recording was explicitly asked for, ignore LOG_LEVEL_I2C.)
+    if (LOG_LEVEL_I2C < LOG_LEVEL_DEBUG) {
+        return;
+    }
+#endif
+    LogLine line(Log);
+    line << (is_read ? F("I2CREAD ") : F("I2CWRITE")) << F(" @ 0x") <<  // (idefix)
+        LogHex(addr) << F(" ::");
+    if (err) {
+        line << F(" (err ") << err << F(")");
+    } else {
+        line << LogHexBytes(buf, len);
+    }
+    line << F("\r\n");
+}
+
+#ifdef I2C_WIRE_HOOKS
+// TwoWire::endTransmission() and TwoWire::requestFrom() end up in these
+// core functions. Hook them with the linker --wrap option so we see the
+// traffic of libraries that use Wire directly as well.
+extern "C" {
+unsigned char __real_twi_writeTo(
+    unsigned char address, unsigned char* buf, unsigned int len, unsigned char sendStop);
+unsigned char __real_twi_readFrom(
+    unsigned char address, unsigned char* buf, unsigned int len, unsigned char sendStop);
+
+unsigned char __wrap_twi_writeTo(
+    unsigned char address, unsigned char* buf, unsigned int len, unsigned char sendStop)
+{
+    unsigned char err = __real_twi_writeTo(address, buf, len, sendStop);
+    I2CBus::count(len, 0);
+#ifdef I2C_TRACE_RECORD
+    i2c_trace(false, address, buf, len, err);
+#endif
+    return err;
+}
+
+unsigned char __wrap_twi_readFrom(
+    unsigned char address, unsigned char* buf, unsigned int len, unsigned char sendStop)
+{
+    unsigned char err = __real_twi_readFrom(address, buf, len, sendStop);
+    if (!err) {
+        I2CBus::count(0, len);
+    }
+#ifdef I2C_TRACE_RECORD
+    i2c_trace(true, address, buf, len, err);
+#endif
+    return err;
+}
+}
+#endif
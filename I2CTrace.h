@@ -0,0 +1,32 @@
+#ifndef INCLUDED_PE32HUD_I2CTRACE_H
+#define INCLUDED_PE32HUD_I2CTRACE_H
+
+#include "pe32hud.h"
+
+/* I2C transaction traces, one line per transaction:
+ *
+ *   I2CWRITE @ 0x5A :: 0x2,
+ *   I2CREAD  @ 0x5A :: 0x5, 0x91, 0x0, 0x9C, 0x98, 0x4, 0xD, 0x7E,
+ *   I2CREAD  @ 0x5A :: (err 2)
+ *
+ * Wire hooks: build with -DI2C_WIRE_HOOKS and link with
+ * -Wl,--wrap=twi_writeTo,--wrap=twi_readFrom (ESP8266; add both to
+ * platform.local.txt, the TEST_BUILD does so itself). The hooks see
+ * _all_ bus traffic, including that of the Adafruit_CCS811 and rgb_lcd
+ * libraries, and count it for the I2CDevice that holds the bus (see
+ * I2CBus::count()). Without them, only the bytes of I2CBus::write() and
+ * read() are counted.
+ *
+ * Recording: build with -DI2C_TRACE_RECORD as well (it implies the
+ * hooks on the ESP8266). Then all that traffic is written to the log.
+ * Use a larger -DLOG_BUFFER_SIZE so no lines are dropped.
+ *
+ * Replaying: see "make replay" and local_bogoduino/replay/Wire.h. */
+
+#if defined(I2C_TRACE_RECORD) && defined(ARDUINO_ARCH_ESP8266) && !defined(I2C_WIRE_HOOKS)
+#define I2C_WIRE_HOOKS
+#endif
+
+void i2c_trace(bool is_read, uint8_t addr, const uint8_t* buf, size_t len, uint8_t err);
+
+#endif //INCLUDED_PE32HUD_I2CTRACE_H
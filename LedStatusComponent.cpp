@@ -0,0 +1,52 @@
+#include "LedStatusComponent.h"
+
+// A static table in flash, instead of a (RAM) copy per instance.
+const int8_t LedStatusComponent::m_blinktimes[6][14] PROGMEM = {
+    // 100=red_on(100ms), -100=red_off(100ms), 0=stop
+    // Using multiples of 100 for longer duration because we can't fit much more in an uint8_t.
+    {10, 0},                                                        // BLINK_NORMAL (no blue)
+    {100, 0},                                                       // BLINK_BOOT
+    {100, 100, 100, -100, 100, 0},                                  // BLINK_WIFI   "wiii-fi"
+    {100, -100, 100, -100, 100, 0},                                 // BLINK_DHT11  "d-h-t"
+    {100, -100, 100, 100, 100, -100, 100, 0},                       // BLINK_CCS811 "c-ooo-2"
+    {50, -50, 50, -50, 50, -50, 50, -50, 50, -50, 50, -50, 50, 0}   // BLINK_SUNSCREEN
+};
+
+uint8_t LedStatusComponent::step()
+{
+    // Not doing anything?
+    if (m_blinktime == NULL) {
+        if (m_blinkmode != NO_BLINK) {
+            // Start blinking.
+            m_blinktime = m_blinktimes[m_blinkmode];
+            m_lastact = millis();
+            return SET_RED | (blinktime() > 0 ? RED_ON : 0) |
+                SET_BLUE | (m_blinkmode != BLINK_NORMAL ? BLUE_ON : 0);
+        }
+        return 0;
+    }
+
+    // The current value is not 0 but -100 or 100.
+    int8_t cur = blinktime();
+    if (cur) {
+        uint8_t abs_time = (cur >= 0 ? cur : -cur);
+        if ((millis() - m_lastact) >= abs_time) {
+            m_blinktime++;
+            m_lastact = millis();
+            return SET_RED | (blinktime() > 0 ? RED_ON : 0);
+        }
+        // The current value is 0 and we've waited for a second.
+    } else if ((millis() - m_lastact) >= 1000) {
+        m_lastact = millis();
+        if (m_blinkmode == NO_BLINK) {
+            // Stop blinking.
+            m_blinktime = NULL;
+            return SET_RED | SET_BLUE;
+        }
+        // Restart blinking.
+        m_blinktime = m_blinktimes[m_blinkmode];
+        return SET_RED | (blinktime() > 0 ? RED_ON : 0) |
+            SET_BLUE | (m_blinkmode != BLINK_NORMAL ? BLUE_ON : 0);
+    }
+    return 0;
+}
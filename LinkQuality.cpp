@@ -0,0 +1,41 @@
+#include "LinkQuality.h"
+
+void LinkQuality::reset()
+{
+    m_rssi16 = 0;
+    m_latency16 = 0;
+    m_rssisamples = 0;
+    m_latencysamples = 0;
+}
+
+void LinkQuality::add_rssi(int8_t rssi)
+{
+    if (!m_rssisamples) {
+        m_rssi16 = rssi * 16;  // start at the first sample, not at 0 dBm
+    } else {
+        m_rssi16 += (rssi * 16 - m_rssi16) / 4;
+    }
+    if (m_rssisamples < 0xff) {
+        m_rssisamples += 1;
+    }
+}
+
+void LinkQuality::add_latency(unsigned long ms)
+{
+    int32_t ms16 = (ms < 60000 ? ms : 60000) * 16;
+    if (!m_latencysamples) {
+        m_latency16 = ms16;
+    } else {
+        m_latency16 += (ms16 - static_cast<int32_t>(m_latency16)) / 4;
+    }
+    if (m_latencysamples < 0xff) {
+        m_latencysamples += 1;
+    }
+}
+
+bool LinkQuality::is_degraded() const
+{
+    // Need a few samples, or the first reading after a connect decides.
+    return (m_rssisamples >= 3 && get_rssi() < DEGRADED_RSSI) ||
+        (m_latencysamples >= 3 && get_latency() > DEGRADED_LATENCY);
+}
@@ -0,0 +1,35 @@
+#ifndef INCLUDED_PE32HUD_LINKQUALITY_H
+#define INCLUDED_PE32HUD_LINKQUALITY_H
+
+#include "pe32hud.h"
+
+/* Smoothed WiFi link quality: RSSI (sampled every network tick) and
+ * HTTP fetch latency, as exponential moving averages (weight 1/4) in
+ * 1/16 fixed point. A single slow fetch or RSSI dip does not make the
+ * link "degraded"; a few in a row do. */
+class LinkQuality {
+public:
+    static constexpr int8_t DEGRADED_RSSI = -72;            // dBm
+    static constexpr unsigned long DEGRADED_LATENCY = 1500; // ms
+
+private:
+    int32_t m_rssi16;
+    uint32_t m_latency16;
+    uint8_t m_rssisamples;
+    uint8_t m_latencysamples;
+
+public:
+    LinkQuality() { reset(); }
+
+    void reset();
+    void add_rssi(int8_t rssi);
+    void add_latency(unsigned long ms);
+
+    int8_t get_rssi() const { return m_rssi16 / 16; }
+    unsigned long get_latency() const { return m_latency16 / 16; }
+    uint8_t get_latency_samples() const { return m_latencysamples; }
+
+    bool is_degraded() const;
+};
+
+#endif //INCLUDED_PE32HUD_LINKQUALITY_H
@@ -0,0 +1,71 @@
+#include "pe32hud.h"
+
+size_t LogBuffer::write(uint8_t ch)
+{
+    if (m_linefailed) {
+        return 0;
+    }
+    uint16_t next = (m_head + 1) % LOG_BUFFER_SIZE;
+    if (next == m_tail) {
+        // Full: forget what we had of this line, so we never emit
+        // half a message.
+        m_head = m_linestart;
+        m_linefailed = true;
+        return 0;
+    }
+    m_buf[m_head] = ch;
+    m_head = next;
+    return 1;
+}
+
+void LogBuffer::begin_line()
+{
+    m_mutex.lock();
+    m_linestart = m_head;
+    m_linefailed = false;
+}
+
+void LogBuffer::end_line()
+{
+    if (m_linefailed) {
+        m_dropped += 1;
+        m_linefailed = false;
+    }
+    m_mutex.unlock();
+}
+
+void LogBuffer::drain()
+{
+    MutexLock lock(m_mutex);
+#if defined(ARDUINO_ARCH_ESP32) || defined(ARDUINO_ARCH_ESP8266)
+    int room = Serial.availableForWrite();
+#else
+    int room = LOG_BUFFER_SIZE;
+#endif
+    // The notice goes between lines, never into one that is half out.
+    if (m_dropped != m_reported && m_drainedline && room >= 32) {
+        Serial << F("(log: ") << (m_dropped - m_reported) << F(" dropped)\r\n");
+        m_reported = m_dropped;
+        room -= 32;
+    }
+    while (room > 0 && m_tail != m_head) {
+        // Write the contiguous part up to the end of the buffer or m_head.
+        uint16_t end = (m_head > m_tail ? m_head : LOG_BUFFER_SIZE);
+        uint16_t len = end - m_tail;
+        if (len > static_cast<uint16_t>(room)) {
+            len = room;
+        }
+        Serial.write(reinterpret_cast<const uint8_t*>(m_buf + m_tail), len);
+        m_tail = (m_tail + len) % LOG_BUFFER_SIZE;
+        m_drainedline = (m_buf[(m_tail + LOG_BUFFER_SIZE - 1) % LOG_BUFFER_SIZE] == '\n');
+        room -= len;
+    }
+}
+
+void LogBuffer::flush()
+{
+    while (m_tail != m_head) {
+        drain();
+        yield();
+    }
+}
@@ -0,0 +1,154 @@
+#ifndef INCLUDED_PE32HUD_LOG_H
+#define INCLUDED_PE32HUD_LOG_H
+
+#include <Arduino.h>	// Print, Serial
+
+#include "Concurrency.h"
+
+/* Logging with compile-time levels per module:
+ *
+ *   LOG_INFO(NETWORK) << F("NetworkComponent: RSSI ") << rssi << F("\r\n");
+ *
+ * If LOG_LEVEL_NETWORK is below LOG_LEVEL_INFO, the whole statement
+ * (including the evaluation of its arguments and the F-strings) is
+ * optimized away. Enabled messages are written into a ring buffer
+ * which is drained to Serial by Log.drain() when loop() is idle, so
+ * logging does not block on the 115200 baud UART. A message that does
+ * not fit is dropped as a whole and counted. setup() has no idle
+ * loop(), so there Log.flush() empties the buffer after each component.
+ * With HAVE_DUALCORE a line holds the buffer Mutex from begin_line() to
+ * end_line(). */
+
+#define LOG_LEVEL_NONE 0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_INFO 3
+#define LOG_LEVEL_DEBUG 4
+
+// Override any of these with -DLOG_LEVEL_<MODULE>=LOG_LEVEL_DEBUG.
+#ifndef LOG_LEVEL_DEFAULT
+#define LOG_LEVEL_DEFAULT LOG_LEVEL_INFO
+#endif
+#ifndef LOG_LEVEL_MAIN
+#define LOG_LEVEL_MAIN LOG_LEVEL_DEFAULT
+#endif
+#ifndef LOG_LEVEL_AIRQUALITY
+#define LOG_LEVEL_AIRQUALITY LOG_LEVEL_DEFAULT
+#endif
+#ifndef LOG_LEVEL_I2C
+#define LOG_LEVEL_I2C LOG_LEVEL_DEFAULT
+#endif
+#ifndef LOG_LEVEL_DISPLAY
+#define LOG_LEVEL_DISPLAY LOG_LEVEL_DEFAULT
+#endif
+#ifndef LOG_LEVEL_LEDSTATUS
+#define LOG_LEVEL_LEDSTATUS LOG_LEVEL_DEFAULT
+#endif
+#ifndef LOG_LEVEL_NETWORK
+#define LOG_LEVEL_NETWORK LOG_LEVEL_DEFAULT
+#endif
+#ifndef LOG_LEVEL_SUNSCREEN
+#define LOG_LEVEL_SUNSCREEN LOG_LEVEL_DEFAULT
+#endif
+#ifndef LOG_LEVEL_TEMPERATURE
+#define LOG_LEVEL_TEMPERATURE LOG_LEVEL_DEFAULT
+#endif
+
+#ifndef LOG_BUFFER_SIZE
+#define LOG_BUFFER_SIZE 512
+#endif
+
+// The if/else form keeps "if (x) LOG_INFO(...) << ...; else ..." sane.
+#define LOG(module, level) \
+    if ((LOG_LEVEL_##module) < (LOG_LEVEL_##level)) {} else LogLine(Log)
+#define LOG_ERROR(module) LOG(module, ERROR)
+#define LOG_WARN(module) LOG(module, WARN)
+#define LOG_INFO(module) LOG(module, INFO)
+#define LOG_DEBUG(module) LOG(module, DEBUG)
+
+class LogBuffer : public Print {
+private:
+    char m_buf[LOG_BUFFER_SIZE];
+    uint16_t m_head;        // write position
+    uint16_t m_tail;        // read (drain) position
+    uint16_t m_linestart;   // m_head at begin_line()
+    bool m_linefailed;      // current line did not fit
+    unsigned long m_dropped;
+    unsigned long m_reported;   // m_dropped as last reported by drain()
+    bool m_drainedline;         // drain() stopped at the end of a line
+    Mutex m_mutex;
+
+public:
+    LogBuffer() : m_head(0), m_tail(0), m_linestart(0), m_linefailed(false),
+        m_dropped(0), m_reported(0), m_drainedline(true) {}
+
+    virtual size_t write(uint8_t ch);
+    using Print::write;
+
+    void begin_line();
+    void end_line();
+
+    // Write out as much as the UART takes without blocking.
+    void drain();
+
+    // Write out everything, waiting for the UART. For setup() only,
+    // where each component logs more than the buffer holds.
+    void flush();
+
+    unsigned long get_dropped() const { return m_dropped; }
+};
+
+extern LogBuffer Log;
+
+struct LogHex {
+    unsigned long value;
+    LogHex(unsigned long v) : value(v) {}
+};
+
+struct LogLcd {
+    const String& text;
+    LogLcd(const String& t) : text(t) {}
+};
+
+struct LogHexBytes {
+    const uint8_t* buf;
+    uint8_t len;
+    LogHexBytes(const uint8_t* b, uint8_t l) : buf(b), len(l) {}
+};
+
+/* Temporary that lives for the duration of one LOG_x() statement. */
+class LogLine {
+private:
+    LogBuffer& m_log;
+
+public:
+    LogLine(LogBuffer& log) : m_log(log) { m_log.begin_line(); }
+    ~LogLine() { m_log.end_line(); }
+
+    template<class T> LogLine& operator<<(const T& arg) {
+        m_log.print(arg);
+        return *this;
+    }
+    LogLine& operator<<(LogHex arg) {
+        m_log.print(arg.value, HEX);
+        return *this;
+    }
+    LogLine& operator<<(LogLcd arg) {
+        // LCD text; the custom characters (GlyphCache) as '~'
+        for (unsigned i = 0; i < arg.text.length(); ++i) {
+            m_log.print(static_cast<uint8_t>(arg.text[i]) < 0x20 ? '~' : arg.text[i]);
+        }
+        return *this;
+    }
+    LogLine& operator<<(LogHexBytes arg) {
+        // " 0x5, 0x91, 0x0," as used in the I2C traces
+        for (uint8_t i = 0; i < arg.len; ++i) {
+            m_log.print(F(" 0x"));
+            m_log.print(arg.buf[i], HEX);
+            m_log.print(',');
+        }
+        return *this;
+    }
+};
+
+#endif //INCLUDED_PE32HUD_LOG_H
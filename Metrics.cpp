@@ -0,0 +1,186 @@
+#include "Metrics.h"
+
+// Appends to a fixed buffer. Once something does not fit, everything
+// after it is dropped; a scraper must not get half a line.
+class MetricsWriter {
+    char* const m_buf;
+    const size_t m_size;
+    size_t m_len;
+    bool m_full;
+
+public:
+    MetricsWriter(char* buf, size_t size) :
+        m_buf(buf), m_size(size), m_len(0), m_full(size == 0) {}
+
+    void put(char ch) {
+        if (m_full || m_len + 1 >= m_size) {
+            m_full = true;
+            return;
+        }
+        m_buf[m_len++] = ch;
+    }
+    void put_P(PGM_P str) {
+        for (char ch; (ch = pgm_read_byte(str)) != '\0'; ++str) {
+            put(ch);
+        }
+    }
+    void put(uint32_t value) {
+        char digits[10];
+        uint8_t n = 0;
+        do {
+            digits[n++] = '0' + value % 10;
+            value /= 10;
+        } while (value);
+        while (n) {
+            put(digits[--n]);
+        }
+    }
+    void put_ms(uint32_t seconds, uint16_t ms) {
+        // As seconds, the Prometheus base unit.
+        put(seconds);
+        put('.');
+        put(static_cast<char>('0' + ms / 100 % 10));
+        put(static_cast<char>('0' + ms / 10 % 10));
+        put(static_cast<char>('0' + ms % 10));
+    }
+
+    void type(PGM_P name, PGM_P type) {
+        put_P(PSTR("# TYPE "));
+        put_P(name);
+        put(' ');
+        put_P(type);
+        put('\n');
+    }
+    void sample(PGM_P name, PGM_P suffix, PGM_P labels, uint32_t value, bool ms) {
+        put_P(name);
+        put_P(suffix);
+        put_P(labels);
+        put(' ');
+        if (ms) {
+            put_ms(value / 1000, value % 1000);
+        } else {
+            put(value);
+        }
+        put('\n');
+    }
+    void counter(PGM_P name, uint32_t value) {
+        type(name, PSTR("counter"));
+        sample(name, PSTR(""), PSTR(""), value, false);
+    }
+    void gauge(PGM_P name, uint32_t value, bool ms = false) {
+        type(name, PSTR("gauge"));
+        sample(name, PSTR(""), PSTR(""), value, ms);
+    }
+    void total(PGM_P name, PGM_P suffix, uint32_t seconds, uint16_t ms) {
+        put_P(name);
+        put_P(suffix);
+        put(' ');
+        put_ms(seconds, ms);
+        put('\n');
+    }
+
+    size_t finish() {
+        if (m_full) {
+            if (m_size) {
+                m_buf[0] = '\0';
+            }
+            return 0;
+        }
+        m_buf[m_len] = '\0';
+        return m_len;
+    }
+};
+
+Metrics::Metrics()
+{
+    memset(m_counters, 0, sizeof(m_counters));
+    memset(m_gauges, 0, sizeof(m_gauges));
+    memset(m_totals, 0, sizeof(m_totals));
+    m_lastloop = 0;     // boot
+}
+
+void Metrics::add(enum total t, unsigned long ms)
+{
+    Total& total = m_totals[t];
+    unsigned long sum = total.ms + ms % 1000;
+    total.seconds += ms / 1000 + sum / 1000;
+    total.ms = sum % 1000;
+}
+
+void Metrics::add_loop(unsigned long ms)
+{
+    // Unsigned subtraction: right across a millis() wrap, as long as
+    // loop() runs at least every 49.7 days.
+    unsigned long now = millis();
+    add(UPTIME, now - m_lastloop);
+    m_lastloop = now;
+
+    m_counters[LOOPS] += 1;
+    if (ms > m_gauges[LOOP_MAX_MS]) {
+        m_gauges[LOOP_MAX_MS] = ms;
+    }
+}
+
+void Metrics::add_fetch(int http_code, unsigned long ms)
+{
+    // HTTPClient returns a negative code when there was no response.
+    if (http_code <= 0) {
+        m_counters[HTTP_ERROR] += 1;
+        return;
+    }
+    m_counters[FETCHES] += 1;
+    add(FETCH_TIME, ms);
+    if (http_code >= 200 && http_code < 600) {
+        m_counters[HTTP_2XX + (http_code / 100 - 2)] += 1;
+    }
+}
+
+size_t Metrics::render(char* buf, size_t size) const
+{
+    static const char fetch[] PROGMEM = "pe32hud_fetch_seconds";
+    static const char http[] PROGMEM = "pe32hud_http_responses_total";
+    static const char wifi_down[] PROGMEM = "pe32hud_wifi_down_seconds_total";
+    static const char http_classes[][16] PROGMEM = {
+        "{class=\"error\"}", "{class=\"2xx\"}", "{class=\"3xx\"}",
+        "{class=\"4xx\"}", "{class=\"5xx\"}"};
+
+    MetricsWriter out(buf, size);
+    // Whole seconds: with HAVE_DUALCORE, add_loop() runs on the other
+    // core, and the ms could be read mid-carry.
+    out.gauge(PSTR("pe32hud_uptime_seconds"), m_totals[UPTIME].seconds);
+    out.counter(PSTR("pe32hud_loops_total"), m_counters[LOOPS]);
+    out.gauge(PSTR("pe32hud_loop_max_seconds"), m_gauges[LOOP_MAX_MS], true);
+
+    out.type(fetch, PSTR("summary"));
+    out.total(fetch, PSTR("_sum"), m_totals[FETCH_TIME].seconds, m_totals[FETCH_TIME].ms);
+    out.sample(fetch, PSTR("_count"), PSTR(""), m_counters[FETCHES], false);
+    out.type(http, PSTR("counter"));
+    for (uint8_t i = 0; i <= HTTP_5XX - HTTP_ERROR; ++i) {
+        out.sample(http, PSTR(""), http_classes[i], m_counters[HTTP_ERROR + i], false);
+    }
+
+    out.counter(PSTR("pe32hud_mqtt_connects_total"), m_counters[MQTT_CONNECTS]);
+    out.counter(PSTR("pe32hud_mqtt_connect_failures_total"), m_counters[MQTT_CONNECT_FAILURES]);
+    out.counter(PSTR("pe32hud_mqtt_drops_total"), m_counters[MQTT_DROPS]);
+    out.counter(PSTR("pe32hud_publishes_total"), m_counters[PUBLISHES]);
+    out.counter(PSTR("pe32hud_publish_drops_total"), m_counters[PUBLISH_DROPS]);
+
+    out.gauge(PSTR("pe32hud_wifi_connected"), m_gauges[WIFI_CONNECTED]);
+    out.counter(PSTR("pe32hud_wifi_changes_total"), m_counters[WIFI_CHANGES]);
+    out.type(wifi_down, PSTR("counter"));
+    out.total(wifi_down, PSTR(""), m_totals[WIFI_DOWN_TIME].seconds, m_totals[WIFI_DOWN_TIME].ms);
+
+    out.gauge(PSTR("pe32hud_ccs811_state"), m_gauges[CCS811_STATE]);
+    out.counter(PSTR("pe32hud_ccs811_changes_total"), m_counters[CCS811_CHANGES]);
+
+#if defined(ARDUINO_ARCH_ESP8266)
+    out.gauge(PSTR("pe32hud_heap_free_bytes"), ESP.getFreeHeap());
+    out.gauge(PSTR("pe32hud_heap_max_block_bytes"), ESP.getMaxFreeBlockSize());
+#elif defined(ARDUINO_ARCH_ESP32)
+    out.gauge(PSTR("pe32hud_heap_free_bytes"), ESP.getFreeHeap());
+    out.gauge(PSTR("pe32hud_heap_max_block_bytes"), ESP.getMaxAllocHeap());
+#endif
+
+    out.counter(PSTR("pe32hud_scrapes_total"), m_counters[SCRAPES]);
+    return out.finish();
+}
@@ -0,0 +1,84 @@
+#ifndef INCLUDED_PE32HUD_METRICS_H
+#define INCLUDED_PE32HUD_METRICS_H
+
+#include "pe32hud.h"
+
+/* Performance counters, scraped from the NetworkComponent metrics
+ * endpoint (see METRICS_PORT) in the Prometheus text format:
+ *
+ *   # TYPE pe32hud_loops_total counter
+ *   pe32hud_loops_total 81734
+ *
+ * Counting is an add on a 32-bit word. Every counter is written from
+ * one core only (the loop and sensor ones from the application core,
+ * the rest from the network core, see HAVE_DUALCORE) and aligned words
+ * do not tear, so there is no Mutex here. render() writes into the
+ * caller's buffer and does not allocate.
+ *
+ * Times add up in whole seconds plus a ms remainder, so that they do
+ * not wrap with millis() after 49.7 days; that includes the uptime,
+ * which add_loop() advances by the millis() since its last call. */
+class Metrics {
+public:
+    enum counter {
+        LOOPS = 0,              // loop() passes
+        FETCHES,                // HUD fetches that got an HTTP response
+        HTTP_ERROR,             // HUD fetches by outcome: no response
+        HTTP_2XX,
+        HTTP_3XX,
+        HTTP_4XX,
+        HTTP_5XX,
+        MQTT_CONNECTS,
+        MQTT_CONNECT_FAILURES,
+        MQTT_DROPS,             // lost an established connection
+        PUBLISHES,
+        PUBLISH_DROPS,          // pushed out of a full MQTT window
+        WIFI_CHANGES,
+        CCS811_CHANGES,
+        SCRAPES,
+        NUM_COUNTERS
+    };
+    enum gauge {
+        LOOP_MAX_MS = 0,        // longest loop() pass since boot
+        WIFI_CONNECTED,
+        CCS811_STATE,
+        NUM_GAUGES
+    };
+    enum total {
+        UPTIME = 0,             // application core, see add_loop()
+        FETCH_TIME,             // time spent in FETCHES
+        WIFI_DOWN_TIME,         // completed outages only
+        NUM_TOTALS
+    };
+
+private:
+    struct Total {
+        uint32_t seconds;
+        uint16_t ms;            // below 1000
+    };
+
+    uint32_t m_counters[NUM_COUNTERS];
+    uint32_t m_gauges[NUM_GAUGES];
+    Total m_totals[NUM_TOTALS];
+    unsigned long m_lastloop;   // millis() at the last add_loop()
+
+public:
+    Metrics();
+
+    void count(enum counter c, uint32_t n = 1) { m_counters[c] += n; }
+    void set(enum gauge g, uint32_t value) { m_gauges[g] = value; }
+    void add(enum total t, unsigned long ms);
+
+    void add_loop(unsigned long ms);
+    void add_fetch(int http_code, unsigned long ms);
+
+    uint32_t get(enum counter c) const { return m_counters[c]; }
+    uint32_t get(enum gauge g) const { return m_gauges[g]; }
+    uint32_t get_seconds(enum total t) const { return m_totals[t].seconds; }
+
+    // The scrape body, NUL terminated. Returns its length, or 0 if it
+    // did not fit.
+    size_t render(char* buf, size_t size) const;
+};
+
+#endif //INCLUDED_PE32HUD_METRICS_H
@@ -1,35 +1,97 @@
 #include "NetworkComponent.h"
 
 #include "Device.h"
+#include "FlightRecorder.h"
+#include "Metrics.h"
 
 extern Device Device;
+extern FlightRecorder FlightRecorder;
+extern Metrics Metrics;
+
+// Like String::startsWith(), but with a PSTR() prefix that stays in flash.
+static inline bool starts_with_P(const String& str, PGM_P prefix)
+{
+    return strncmp_P(str.c_str(), prefix, strlen_P(prefix)) == 0;
+}
+
+// Check for updates a minute after boot, and every m_update_interval
+// after that.
+static constexpr unsigned long UPDATE_FIRST_CHECK = 60000;
+// Give up on an OTA download that stalls this long, or takes this long
+// in total (see write_update()).
+static constexpr unsigned long UPDATE_STALL_MS = 10000;
+static constexpr unsigned long UPDATE_MAX_MS = 120000;
 
 NetworkComponent::NetworkComponent()
+    : m_lasthttpcode(0), m_lastupdatecheck(0), m_remotesource(NO_SOURCE),
+    m_remoteshown(false), m_remotestale(false)
 #ifdef HAVE_ESPWIFI
-    : m_wifistatus(WL_DISCONNECTED), m_mqttclient(m_mqttbackend)
+    , m_wifistatus(WL_DISCONNECTED), m_mqttclient(m_mqttbackend),
+    m_noutbox(0), m_mqttstate(MQTT_DOWN), m_mqttfailures(0), m_mqtttries(0), m_mqttwait(0),
+    m_mqttsince(0), m_mqttdownsince(0), m_jitter(1), m_mqttstats(),
+    m_brokerresolved(0), m_brokercached(false),
+    m_roamstate(ROAM_IDLE), m_scanned(false), m_lastscan(0), m_roamticks(0),
+    m_roamsince(0), m_roamrssi(0), m_roamlatency(0), m_roamhadlatency(false)
+#if METRICS_PORT
+    , m_metricsserver(METRICS_PORT), m_metricssince(0), m_metricsreqlen(0), m_metricseol(0)
+#endif
 #endif
 {
+    m_sources.add(F(SECRET_HUD_URL));
+#ifdef SECRET_HUD_URL2
+    m_sources.add(F(SECRET_HUD_URL2));
+#endif
 }
 
 void NetworkComponent::setup()
 {
-    Device.set_guid(String("EUI48:") + WiFi.macAddress());
+    Device.set_guid(String(F("EUI48:")) + WiFi.macAddress());
     Device.set_alert(Device::INACTIVE_WIFI);
     m_wifidowntime = millis();
 #ifdef HAVE_ESPWIFI
     WiFi.mode(WIFI_STA);
     WiFi.persistent(false);         // false is default, we don't need to save to flash
     WiFi.setAutoReconnect(false);   // we don't need this, we do it manually?
+#if METRICS_PORT
+    m_metricsserver.begin();        // listens on whatever link we get
+#endif
     handle_wifi_state_change(WL_IDLE_STATUS);
     m_wifistatus = WL_IDLE_STATUS;
     m_wifidowntime = m_lastact = millis();
     // Do not forget setId(). Some MQTT daemons will reject id-less connections.
+    // It is derived from the MAC, so a persistent session survives reboots.
     m_mqttclient.setId(String(Device.get_guid()).substring(0, 23));
+#if MQTT_PERSISTENT_SESSION
+    m_mqttclient.setCleanSession(false);
+#endif
+    // Bound both the TCP connect and the wait for the CONNACK. The
+    // WiFiClient of ESP32 cores before 3.0 takes seconds, not ms.
+#if defined(ARDUINO_ARCH_ESP32) && (!defined(ESP_ARDUINO_VERSION_MAJOR) || ESP_ARDUINO_VERSION_MAJOR < 3)
+    m_mqttbackend.setTimeout((MQTT_DEADLINE + 999) / 1000);
+#else
+    m_mqttbackend.setTimeout(MQTT_DEADLINE);
+#endif
+    m_mqttclient.setConnectionTimeout(MQTT_DEADLINE);
+    // FNV-1a of the GUID: same jitter sequence per device, different
+    // between devices.
+    m_jitter = 2166136261U;
+    for (const char* p = Device.get_guid(); *p; ++p) {
+        m_jitter = (m_jitter ^ static_cast<uint8_t>(*p)) * 16777619U;
+    }
+    m_jitter |= 1;
 #endif
 }
 
 void NetworkComponent::loop()
 {
+#ifdef HAVE_DUALCORE
+    // Publishes handed over by the application core.
+    const __FlashStringHelper* topic;
+    String formdata;
+    while (Device.take_publish(topic, formdata)) {
+        push_remote(topic, formdata);
+    }
+#endif
 #ifdef HAVE_ESPWIFI
     wl_status_t wifistatus;
     if ((millis() - m_lastact) >= 3000 && (
@@ -38,7 +100,8 @@ void NetworkComponent::loop()
             handle_wifi_state_change(wifistatus);
             m_wifistatus = wifistatus;
             // Don't set m_lastact. We'll want to run WL_CONNECTED code below.
-        } else if (m_wifistatus != WL_CONNECTED && (millis() - m_wifidowntime) > 5000) {
+        } else if (m_wifistatus != WL_CONNECTED && (millis() - m_wifidowntime) > 5000 &&
+                !is_roaming()) {
             wifistatus = WL_IDLE_STATUS;
             handle_wifi_state_change(wifistatus);
             m_wifistatus = wifistatus;
@@ -46,67 +109,232 @@ void NetworkComponent::loop()
         }
     }
 #endif
+    if (m_wifistatus == WL_CONNECTED) {
+        step_mqtt();
+#if METRICS_PORT
+        step_metrics();
+#endif
+    }
     if (m_wifistatus == WL_CONNECTED && (millis() - m_lastact) >= m_interval) {
         const unsigned char *bssid = WiFi.BSSID();
-        Serial << F("NetworkComponent: RSSI: ") << WiFi.RSSI() << F(", BSSID: 0x");
-        Serial.print(bssid[0], HEX);
-        Serial.print(bssid[1], HEX);
-        Serial.print(bssid[2], HEX);
-        Serial.print(bssid[3], HEX);
-        Serial.print(bssid[4], HEX);
-        Serial.print(bssid[5], HEX);
-        Serial << F("\r\n");
+        int8_t rssi = WiFi.RSSI();
+        m_link.add_rssi(rssi);
+        Device.set_reading(Device::READING_RSSI, rssi);
+        LOG_DEBUG(NETWORK) << F("NetworkComponent: RSSI: ") << rssi <<  // (idefix)
+            F(" (avg ") << m_link.get_rssi() << F("), BSSID: 0x") << LogHex(bssid[0]) << LogHex(bssid[1]) <<  // (idefix)
+            LogHex(bssid[2]) << LogHex(bssid[3]) << LogHex(bssid[4]) <<  // (idefix)
+            LogHex(bssid[5]) << F("\r\n");
+        step_roam();
         ensure_mqtt();
         sample();
+        // Not over a degraded link: the download would block longest
+        // there. Check again once it has recovered.
+        if ((millis() - m_lastupdatecheck) >= (
+                m_lastupdatecheck ? m_update_interval : UPDATE_FIRST_CHECK) &&
+                !m_link.is_degraded()) {
+            check_update();
+            m_lastupdatecheck = millis();
+        }
         m_lastact = millis();  // after poll, so we don't hammer on failure
     }
 }
 
-void NetworkComponent::push_remote(String topic, String formdata)
+void NetworkComponent::push_remote(const __FlashStringHelper* topic, const String& formdata)
 {
-#if 1
+#ifdef HAVE_ESPWIFI
+    if (m_noutbox == MQTT_WINDOW) {
+        LOG_WARN(NETWORK) << F("NetworkComponent: MQTT window full, dropping ") <<  // (idefix)
+            m_outbox[0].topic << F("\r\n");
+        Metrics.count(Metrics::PUBLISH_DROPS);
+        for (uint8_t i = 1; i < m_noutbox; ++i) {
+            m_outbox[i - 1] = m_outbox[i];
+        }
+        m_noutbox -= 1;
+    }
+    Outgoing& out = m_outbox[m_noutbox++];
+    out.topic = topic;
+    out.formdata = formdata;
+    out.inflight = false;
+    out.dup = false;
     if (m_mqttclient.connected()) {
-        Serial << F("NetworkComponent: push: ") << topic << F(" :: ") <<  // (idefix)
-            F("device_id=") << Device.get_guid() << F("&") << formdata << F("\r\n");
-        m_mqttclient.beginMessage(topic);
-        m_mqttclient.print(F("device_id="));
-        m_mqttclient.print(Device.get_guid());
-        m_mqttclient.print(F("&"));
-        m_mqttclient.print(formdata);
-        m_mqttclient.endMessage();
+        flush_outbox();
     }
 #endif
 }
 
+#ifdef HAVE_ESPWIFI
+void NetworkComponent::flush_outbox()
+{
+    // Retire what has been in flight long enough; keep the rest in order.
+    uint8_t keep = 0;
+    for (uint8_t i = 0; i < m_noutbox; ++i) {
+        if (m_outbox[i].inflight && (millis() - m_outbox[i].sent) >= MQTT_ACK_MS) {
+            continue;
+        }
+        if (keep != i) {
+            m_outbox[keep] = m_outbox[i];
+        }
+        keep += 1;
+    }
+    m_noutbox = keep;
+
+    for (uint8_t i = 0; i < m_noutbox; ++i) {
+        if (!m_outbox[i].inflight && !publish(m_outbox[i])) {
+            break;
+        }
+    }
+}
+
+bool NetworkComponent::publish(Outgoing& out)
+{
+    LOG_INFO(NETWORK) << F("NetworkComponent: push: ") << out.topic <<  // (idefix)
+        (out.dup ? F(" (dup)") : F("")) << F(" :: ") <<  // (idefix)
+        F("device_id=") << Device.get_guid() << F("&") << out.formdata << F("\r\n");
+    m_mqttclient.beginMessage(String(out.topic), false, 1, out.dup);
+    m_mqttclient.print(F("device_id="));
+    m_mqttclient.print(Device.get_guid());
+    m_mqttclient.print(F("&"));
+    m_mqttclient.print(out.formdata);
+    if (!m_mqttclient.endMessage()) {
+        return false;
+    }
+    Metrics.count(Metrics::PUBLISHES);
+    out.sent = millis();
+    out.inflight = true;
+    out.dup = true;  // any resend of this one is a duplicate
+    return true;
+}
+
+bool NetworkComponent::resolve_broker()
+{
+    if (m_brokercached && (millis() - m_brokerresolved) < BROKER_TTL) {
+        return true;
+    }
+    if (!WiFi.hostByName(SECRET_MQTT_BROKER, m_brokerip)) {
+        LOG_WARN(NETWORK) << F("NetworkComponent: cannot resolve " SECRET_MQTT_BROKER "\r\n");
+        m_brokercached = false;
+        return false;
+    }
+    m_brokerresolved = millis();
+    m_brokercached = true;
+    return true;
+}
+#endif
+
+#if defined(HAVE_ESPWIFI) && METRICS_PORT
+void NetworkComponent::step_metrics()
+{
+    if (!m_metricsclient) {
+#if defined(ARDUINO_ARCH_ESP32)
+        m_metricsclient = m_metricsserver.available();
+#else
+        m_metricsclient = m_metricsserver.accept();
+#endif
+        if (!m_metricsclient) {
+            return;
+        }
+        m_metricssince = millis();
+        m_metricsreqlen = 0;
+        m_metricseol = 0;
+    }
+    // Take what has arrived, up to the empty line after the headers.
+    // Only the start of the request line is kept.
+    while (m_metricseol < 2 && m_metricsclient.available() > 0) {
+        char ch = m_metricsclient.read();
+        if (m_metricsreqlen < sizeof(m_metricsreq) - 1) {
+            m_metricsreq[m_metricsreqlen++] = ch;
+        }
+        if (ch == '\n') {
+            m_metricseol += 1;
+        } else if (ch != '\r') {
+            m_metricseol = 0;
+        }
+    }
+    if (m_metricseol < 2) {
+        if (!m_metricsclient.connected() || (millis() - m_metricssince) >= METRICS_TIMEOUT) {
+            m_metricsclient.stop();  // gone, or too slow
+        }
+        return;
+    }
+    answer_metrics();
+    m_metricsclient.stop();
+}
+
+void NetworkComponent::answer_metrics()
+{
+    m_metricsreq[m_metricsreqlen] = '\0';
+    bool found = (strncmp_P(m_metricsreq, PSTR("GET /metrics"), 12) == 0 &&
+                  (m_metricsreq[12] == ' ' || m_metricsreq[12] == '?'));
+    size_t len = 0;
+    if (found) {
+        Metrics.count(Metrics::SCRAPES);
+        len = Metrics.render(m_metricsbuf, sizeof(m_metricsbuf));
+    }
+    char head[128];
+    int headlen;
+    if (!found) {
+        headlen = snprintf_P(head, sizeof(head), PSTR(
+            "HTTP/1.0 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n"));
+    } else if (!len) {
+        LOG_WARN(NETWORK) << F("NetworkComponent: metrics do not fit in ") <<  // (idefix)
+            METRICS_BUFFER_SIZE << F(" bytes\r\n");
+        headlen = snprintf_P(head, sizeof(head), PSTR(
+            "HTTP/1.0 500 Internal Server Error\r\nContent-Length: 0\r\n"
+            "Connection: close\r\n\r\n"));
+    } else {
+        headlen = snprintf_P(head, sizeof(head), PSTR(
+            "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\n"
+            "Content-Length: %u\r\nConnection: close\r\n\r\n"), static_cast<unsigned>(len));
+    }
+    LOG_DEBUG(NETWORK) << F("NetworkComponent: metrics: ") <<  // (idefix)
+        (found ? F("scraped, ") : F("not found, ")) << len << F(" bytes\r\n");
+    m_metricsclient.write(reinterpret_cast<const uint8_t*>(head), headlen);
+    if (len) {
+        m_metricsclient.write(reinterpret_cast<const uint8_t*>(m_metricsbuf), len);
+    }
+}
+#endif
+
 #ifdef HAVE_ESPWIFI
 void NetworkComponent::handle_wifi_state_change(wl_status_t wifistatus)
 {
     // FIXME: translate wifistatus from number to something readable
-    Serial << F("NetworkComponent: Wifi state ") << m_wifistatus << F(" -> ") << wifistatus << F("\r\n");
+    LOG_INFO(NETWORK) << F("NetworkComponent: Wifi state ") << m_wifistatus << F(" -> ") << wifistatus << F("\r\n");
+    FlightRecorder.record(FlightRecorder::EV_WIFI_STATE, m_wifistatus, wifistatus);
+    Metrics.count(Metrics::WIFI_CHANGES);
+    Metrics.set(Metrics::WIFI_CONNECTED, wifistatus == WL_CONNECTED);
 
     if (m_wifistatus == WL_CONNECTED) {
         m_wifidowntime = millis();
+    } else if (wifistatus == WL_CONNECTED) {
+        Metrics.add(Metrics::WIFI_DOWN_TIME, millis() - m_wifidowntime);
+    }
+    if (wifistatus != WL_CONNECTED && is_roaming()) {
+        // Our own move to another AP (see step_roam()); keep the HUD.
+        return;
     }
-    String downtime(String("") + ((millis() - m_wifidowntime) / 1000) + " downtime");
+    String downtime((millis() - m_wifidowntime) / 1000);
+    downtime += F(" downtime");
 
     switch (wifistatus) {
         case WL_IDLE_STATUS:
+            m_roamstate = ROAM_IDLE;  // a move that never connected
             Device.set_alert(Device::INACTIVE_WIFI);
-            Device.set_error(F("Wifi connecting"), downtime);
+            show_error(F("Wifi connecting"), downtime);
             WiFi.disconnect(true, true);
 #ifdef SECRET_WIFI_BSSID
             // Speed up wifi connect, especially for poor (<= -70 RSSI) connections.
             if ((millis() - m_wifidowntime) < 30000) {
                 const uint8_t bssid[6] = SECRET_WIFI_BSSID;
                 WiFi.begin(SECRET_WIFI_SSID, SECRET_WIFI_PASS, 0, bssid, true);
-                Serial << F("NetworkComponent: Wifi connecting (with preset BSSID)...\r\n");
+                LOG_INFO(NETWORK) << F("NetworkComponent: Wifi connecting (with preset BSSID)...\r\n");
             } else {
                 WiFi.begin(SECRET_WIFI_SSID, SECRET_WIFI_PASS);
-                Serial << F("NetworkComponent: Wifi connecting...\r\n");
+                LOG_INFO(NETWORK) << F("NetworkComponent: Wifi connecting...\r\n");
             }
 #else
             WiFi.begin(SECRET_WIFI_SSID, SECRET_WIFI_PASS);
-            Serial << F("NetworkComponent: Wifi connecting...\r\n");
+            LOG_INFO(NETWORK) << F("NetworkComponent: Wifi connecting...\r\n");
 #endif
             break;
         case WL_CONNECTED:
@@ -116,51 +344,239 @@ void NetworkComponent::handle_wifi_state_change(wl_status_t wifistatus)
         case WL_CONNECT_FAILED:
         case WL_DISCONNECTED:
             Device.set_alert(Device::INACTIVE_WIFI);
-            Device.set_error(String(F("Wifi state ")) + wifistatus, downtime);
+            show_error(String(F("Wifi state ")) + wifistatus, downtime);
             break;
 #ifdef WL_CONNECT_WRONG_PASSWORD
         case WL_CONNECT_WRONG_PASSWORD:
             Device.set_alert(Device::INACTIVE_WIFI);
-            Device.set_error(F("Wifi wrong creds."), downtime);
+            show_error(F("Wifi wrong creds."), downtime);
             break;
 #endif
         default:
             Device.set_alert(Device::INACTIVE_WIFI);
-            Device.set_error(String(F("Wifi unknown ")) + wifistatus, downtime);
+            show_error(String(F("Wifi unknown ")) + wifistatus, downtime);
             break;
     }
-#ifdef DEBUG
-    Serial << F("  --NetworkComponent: Wifi values BEGIN\r\n");
-    WiFi.printDiag(Serial);  // FIXME/XXX: beware, shows password on serial output
-    Serial << F("  --NetworkComponent: Wifi values END\r\n");
-#endif
+    // No WiFi.printDiag() here: it writes the passphrase to the serial
+    // output, synchronously.
 }
 #endif
 
 void NetworkComponent::ensure_mqtt()
 {
+    if (m_mqttstate != MQTT_UP) {
+        return;  // step_mqtt() is on it
+    }
     m_mqttclient.poll();
     if (!m_mqttclient.connected()) {
-        if (m_mqttclient.connect(SECRET_MQTT_BROKER, SECRET_MQTT_PORT)) {
-            Serial << F("NetworkComponent: MQTT connected to " SECRET_MQTT_BROKER "\r\n");
+        return;  // don't retire anything; step_mqtt() will resend
+    }
+    flush_outbox();
+    // Publish the history of the previous boot(s) once per boot.
+    if (FlightRecorder.has_unpublished()) {
+        push_remote(F("pe32/hud/flightrec/xwwwform"), FlightRecorder.to_formdata());
+        FlightRecorder.mark_published();
+    }
+}
+
+#ifdef HAVE_ESPWIFI
+static void append_bssid(String& out, const uint8_t* bssid)
+{
+    static const char hexdigits[] PROGMEM = "0123456789abcdef";
+    for (uint8_t i = 0; i < 6; ++i) {
+        out += static_cast<char>(pgm_read_byte(&hexdigits[bssid[i] >> 4]));
+        out += static_cast<char>(pgm_read_byte(&hexdigits[bssid[i] & 0xf]));
+    }
+}
+
+void NetworkComponent::step_roam()
+{
+    switch (m_roamstate) {
+    case ROAM_IDLE:
+        if (m_link.is_degraded() && (!m_scanned || (millis() - m_lastscan) >= ROAM_HOLDOFF)) {
+            LOG_INFO(NETWORK) << F("NetworkComponent: link degraded (RSSI ") <<  // (idefix)
+                m_link.get_rssi() << F(", ") << m_link.get_latency() <<  // (idefix)
+                F(" ms), scanning\r\n");
+            WiFi.scanNetworks(true);  // async; see scanComplete()
+            m_scanned = true;
+            m_lastscan = millis();
+            m_roamstate = ROAM_SCANNING;
+        }
+        break;
+    case ROAM_SCANNING: {
+        int n = WiFi.scanComplete();
+        if (n == WIFI_SCAN_RUNNING) {
+            break;
+        }
+        m_roamstate = ROAM_IDLE;
+        uint8_t current[6];
+        memcpy(current, WiFi.BSSID(), 6);
+        int best = -1;
+        int32_t best_rssi = m_link.get_rssi() + ROAM_MARGIN - 1;
+        for (int i = 0; i < n; ++i) {
+            if (WiFi.RSSI(i) > best_rssi && memcmp(WiFi.BSSID(i), current, 6) != 0 &&
+                    strcmp_P(WiFi.SSID(i).c_str(), PSTR(SECRET_WIFI_SSID)) == 0) {
+                best = i;
+                best_rssi = WiFi.RSSI(i);
+            }
+        }
+        if (best < 0) {
+            LOG_INFO(NETWORK) << F("NetworkComponent: no better AP among ") << n << F("\r\n");
+            WiFi.scanDelete();
+            break;
+        }
+        memcpy(m_roamfrom, current, 6);
+        memcpy(m_roamto, WiFi.BSSID(best), 6);
+        int32_t channel = WiFi.channel(best);
+        WiFi.scanDelete();
+        m_roamrssi = m_link.get_rssi();
+        m_roamlatency = m_link.get_latency();
+        m_roamhadlatency = (m_link.get_latency_samples() != 0);
+        LOG_INFO(NETWORK) << F("NetworkComponent: roaming from RSSI ") << m_roamrssi <<  // (idefix)
+            F(" to ") << best_rssi << F(" on channel ") << channel << F("\r\n");
+        FlightRecorder.record(FlightRecorder::EV_ROAM, -m_roamrssi, -best_rssi);
+        WiFi.begin(SECRET_WIFI_SSID, SECRET_WIFI_PASS, channel, m_roamto, true);
+        m_roamsince = millis();
+        m_link.reset();
+        m_roamticks = 0;
+        m_roamstate = ROAM_SETTLING;
+        break;
+    }
+    case ROAM_SETTLING:
+        if (++m_roamticks >= ROAM_SETTLE_TICKS) {
+            report_roam();
+            m_roamstate = ROAM_IDLE;
+        }
+        break;
+    }
+}
+
+void NetworkComponent::report_roam()
+{
+    String formdata;
+    formdata.reserve(128);
+    formdata += F("from=");
+    append_bssid(formdata, m_roamfrom);
+    formdata += F("&to=");
+    append_bssid(formdata, m_roamto);
+    formdata += F("&rssi_before=");
+    formdata += static_cast<int>(m_roamrssi);
+    formdata += F("&rssi_after=");
+    formdata += static_cast<int>(m_link.get_rssi());
+    // The latencies only when there were fetches to measure.
+    if (m_roamhadlatency) {
+        formdata += F("&latency_before=");
+        formdata += m_roamlatency;
+    }
+    if (m_link.get_latency_samples()) {
+        formdata += F("&latency_after=");
+        formdata += m_link.get_latency();
+    }
+    push_remote(F("pe32/hud/roam/xwwwform"), formdata);
+}
+
+void NetworkComponent::step_mqtt()
+{
+    switch (m_mqttstate) {
+    case MQTT_UP:
+        if (m_mqttclient.connected()) {
+            break;
+        }
+        LOG_WARN(NETWORK) << F("NetworkComponent: MQTT connection lost\r\n");
+        Metrics.count(Metrics::MQTT_DROPS);
+        // Nothing in flight is known to have arrived; send it again.
+        for (uint8_t i = 0; i < m_noutbox; ++i) {
+            m_outbox[i].inflight = false;
+        }
+        m_mqttdownsince = millis();
+        m_mqttfailures = 0;
+        m_mqtttries = 0;
+        // Everyone lost the broker at the same time; don't all come back
+        // at the same time.
+        backoff_mqtt();
+        break;
+    case MQTT_DOWN:
+        m_mqttdownsince = millis();
+        m_mqttfailures = 0;
+        m_mqtttries = 0;
+        m_mqttstate = MQTT_RESOLVE;
+        break;
+    case MQTT_WAIT:
+        if ((millis() - m_mqttsince) >= m_mqttwait) {
+            m_mqttstate = MQTT_RESOLVE;
+        }
+        break;
+    case MQTT_RESOLVE:
+        if (resolve_broker()) {
+            m_mqttstate = MQTT_CONNECT;
+        } else {
+            backoff_mqtt();
+        }
+        break;
+    case MQTT_CONNECT:
+        m_mqttstats.attempts += 1;
+        m_mqtttries += 1;
+        if (m_mqttclient.connect(m_brokerip, SECRET_MQTT_PORT)) {
+            m_mqttstats.time_to_connect = millis() - m_mqttdownsince;
+            LOG_INFO(NETWORK) << F("NetworkComponent: MQTT connected to " SECRET_MQTT_BROKER " (") <<  // (idefix)
+                m_brokerip.toString() << F(") after ") << m_mqtttries <<  // (idefix)
+                F(" attempt(s), ") << m_mqttstats.time_to_connect << F(" ms\r\n");
+            FlightRecorder.record(FlightRecorder::EV_MQTT_CONNECT, 1, m_mqtttries);
+            Metrics.count(Metrics::MQTT_CONNECTS);
+            m_mqttstate = MQTT_UP;
+            flush_outbox();
         } else {
-            Serial << F("NetworkComponent: MQTT connection to "
+            m_mqttstats.failures += 1;
+            LOG_WARN(NETWORK) << F("NetworkComponent: MQTT connection to "
                 SECRET_MQTT_BROKER " failed: ") <<  // (idefix)
                 m_mqttclient.connectError() << F("\r\n");
+            FlightRecorder.record(
+                FlightRecorder::EV_MQTT_CONNECT, 0, m_mqttclient.connectError());
+            Metrics.count(Metrics::MQTT_CONNECT_FAILURES);
+            m_brokercached = false;  // maybe it moved
+            backoff_mqtt();
         }
+        break;
     }
 }
 
-void NetworkComponent::sample()
+void NetworkComponent::backoff_mqtt()
 {
-#ifdef DEBUG
-    Serial << F("  --NetworkComponent: fetch/update\r\n");
+    unsigned long wait = MQTT_BACKOFF_MAX;
+    if (m_mqttfailures < 16 && (MQTT_BACKOFF_MIN << m_mqttfailures) < MQTT_BACKOFF_MAX) {
+        wait = MQTT_BACKOFF_MIN << m_mqttfailures;
+    }
+    if (m_mqttfailures < 0xff) {
+        m_mqttfailures += 1;
+    }
+    // Keep half, randomize the other half.
+    m_jitter ^= m_jitter << 13;
+    m_jitter ^= m_jitter >> 17;
+    m_jitter ^= m_jitter << 5;
+    m_mqttwait = wait / 2 + m_jitter % (wait / 2 + 1);
+    m_mqttsince = millis();
+    m_mqttstate = MQTT_WAIT;
+    LOG_DEBUG(NETWORK) << F("NetworkComponent: MQTT retry in ") << m_mqttwait << F(" ms\r\n");
+}
 #endif
+
+void NetworkComponent::sample()
+{
+    LOG_DEBUG(NETWORK) << F("  --NetworkComponent: fetch/update\r\n");
     String remote_packet = fetch_remote();
     if (remote_packet.length()) {
-        RemoteResult res;
-        parse_remote(remote_packet, res);
-        handle_remote(res);
+        if (m_remotestale) {
+            Device.set_stale(false);
+            m_remotestale = false;
+        }
+        uint8_t changed = parse_remote(remote_packet, m_remote);
+        if (changed & REMOTE_BAD_BASE) {
+            LOG_WARN(NETWORK) << F("NetworkComponent: HUD delta not against v") <<  // (idefix)
+                m_remote.version << F(", asking for a snapshot\r\n");
+            m_remote.version = 0;
+            return;
+        }
+        handle_remote(m_remote, changed);
     }
 }
 
@@ -168,26 +584,77 @@ String NetworkComponent::fetch_remote()
 {
     String payload;
 #ifdef HAVE_HTTPCLIENT
-    HTTPClient http;
-    http.begin(m_httpbackend, SECRET_HUD_URL);
-    int http_code = http.GET();
-    if (http_code >= 200 && http_code < 300) {
-        // Fetch data and truncate just in case.
-        payload = http.getString().substring(0, 512);
-    } else {
-        Device.set_error(String(F("HTTP/")) + http_code, F("(error)"));
+    // Try the sources best first (see HudSources), each within its
+    // budget, until one answers.
+    uint8_t order[HudSources::MAX_SOURCES];
+    uint8_t n = m_sources.order(order);
+    int http_code = m_lasthttpcode;
+    bool ok = false;
+    for (uint8_t i = 0; i < n && !ok; ++i) {
+        uint8_t idx = order[i];
+        HTTPClient http;
+        http.setTimeout(HudSources::FETCH_BUDGET);
+#if defined(ARDUINO_ARCH_ESP32)
+        http.setConnectTimeout(HudSources::FETCH_BUDGET);
+#endif
+        // Ask for the changes since our version (see RemoteResult).
+        // Versions are per source, so another source gets v=0 and
+        // sends a snapshot.
+        String url(m_sources.get_url(idx));
+        url += (url.indexOf('?') < 0 ? '?' : '&');
+        url += F("v=");
+        url += (idx == m_remotesource ? m_remote.version : 0);
+        http.begin(m_httpbackend, url);
+        unsigned long start = millis();
+        http_code = http.GET();
+        unsigned long elapsed = millis() - start;
+        if (http_code > 0) {
+            m_link.add_latency(elapsed);
+        }
+        Metrics.add_fetch(http_code, elapsed);
+        if (http_code != m_lasthttpcode) {
+            // Only record changes, or we'd flush the recorder in minutes.
+            FlightRecorder.record(FlightRecorder::EV_HTTP_CODE, idx, http_code);
+            m_lasthttpcode = http_code;
+        }
+        if (http_code >= 200 && http_code < 300) {
+            // Fetch data and truncate just in case.
+            payload = http.getString().substring(0, 512);
+            m_sources.add_success(idx, elapsed);
+            if (idx != m_remotesource && m_remotesource != NO_SOURCE) {
+                LOG_INFO(NETWORK) << F("NetworkComponent: HUD from source ") <<  // (idefix)
+                    idx << F(" (") << m_sources.get_latency(idx) << F(" ms)\r\n");
+            }
+            m_remotesource = idx;
+            ok = true;
+        } else {
+            m_sources.add_failure(idx);
+            LOG_WARN(NETWORK) << F("NetworkComponent: HUD source ") << idx <<  // (idefix)
+                F(" failed: HTTP/") << http_code << F(", ") <<  // (idefix)
+                m_sources.get_errors(idx) << F(" errors\r\n");
+        }
+        http.end();
+    }
+    if (!ok && m_remotesource != NO_SOURCE) {
+        // Keep the last good payload on screen, marked as stale.
+        if (!m_remotestale) {
+            Device.set_stale(true);
+            m_remotestale = true;
+        }
+    } else if (!ok) {
+        show_error(String(F("HTTP/")) + http_code, F("(error)"));
     }
-    http.end();
 #endif
     return payload;
 }
 
-void NetworkComponent::parse_remote(const String& remote_packet, RemoteResult& res)
+uint8_t NetworkComponent::parse_remote(const String& remote_packet, RemoteResult& res)
 {
     int start = 0;
     bool done = false;
-
-    res.color = Device::COLOR_YELLOW;
+    bool started = false;       // seen the first field (after the headers)
+    uint32_t version = 0;
+    RemoteResult next;
 
     while (!done) {
         String line;
@@ -200,24 +667,204 @@ void NetworkComponent::parse_remote(const String& remote_packet, RemoteResult& r
             start = lf + 1;
         }
 
-        if (line.startsWith("color:#")) {
-            res.color = strtol(line.c_str() + 7, NULL, 16);
-        } else if (line.startsWith("line0:")) {
-            res.message0 = line.substring(6); //, 6 + LCD_COLS);
-        } else if (line.startsWith("line1:")) {
-            res.message1 = line.substring(6); //, 6 + LCD_COLS);
-        } else if (line.startsWith("action:UP")) {
-            res.sunscreen = Device::ACTION_SUNSCREEN_UP;
-        } else if (line.startsWith("action:RESET")) {
-            res.sunscreen = Device::ACTION_SUNSCREEN_NONE;
-        } else if (line.startsWith("action:DOWN")) {
-            res.sunscreen = Device::ACTION_SUNSCREEN_DOWN;
+        if (!started) {
+            if (starts_with_P(line, PSTR("version:"))) {
+                version = strtoul(line.c_str() + 8, NULL, 10);
+                continue;
+            }
+            if (starts_with_P(line, PSTR("base:"))) {
+                if (strtoul(line.c_str() + 5, NULL, 10) != res.version || !res.version) {
+                    return REMOTE_BAD_BASE;
+                }
+                next = res;  // a delta: start from what we have
+                continue;
+            }
+            started = true;
+        }
+
+        if (starts_with_P(line, PSTR("color:#"))) {
+            next.color = strtol(line.c_str() + 7, NULL, 16);
+        } else if (starts_with_P(line, PSTR("line0:"))) {
+            next.message0 = line.substring(6); //, 6 + LCD_COLS);
+        } else if (starts_with_P(line, PSTR("line1:"))) {
+            next.message1 = line.substring(6); //, 6 + LCD_COLS);
+        } else if (starts_with_P(line, PSTR("action:UP"))) {
+            next.sunscreen = Device::ACTION_SUNSCREEN_UP;
+        } else if (starts_with_P(line, PSTR("action:RESET"))) {
+            next.sunscreen = Device::ACTION_SUNSCREEN_NONE;
+        } else if (starts_with_P(line, PSTR("action:DOWN"))) {
+            next.sunscreen = Device::ACTION_SUNSCREEN_DOWN;
+        }
+    }
+
+    uint8_t changed = 0;
+    if (next.color != res.color) {
+        changed |= CHANGED_COLOR;
+    }
+    if (next.message0 != res.message0) {
+        changed |= CHANGED_LINE0;
+    }
+    if (next.message1 != res.message1) {
+        changed |= CHANGED_LINE1;
+    }
+    if (next.sunscreen != res.sunscreen) {
+        changed |= CHANGED_ACTION;
+    }
+    next.version = version;
+    res = next;
+    return changed;
+}
+
+void NetworkComponent::show_error(const String& msg0, const String& msg1)
+{
+    Device.set_error(msg0, msg1);
+    m_remoteshown = false;
+}
+
+void NetworkComponent::handle_remote(const RemoteResult& res, uint8_t changed)
+{
+    // Leave the display alone if nothing on it changed, unless an error
+    // message took its place in the meantime.
+    if ((changed & CHANGED_TEXT) || !m_remoteshown) {
+        Device.set_text(res.message0, res.message1, res.color);
+        m_remoteshown = true;
+    }
+    if (changed & CHANGED_ACTION) {
+        Device.add_action(res.sunscreen);
+    }
+}
+
+void NetworkComponent::check_update()
+{
+#if defined(SECRET_OTA_URL) && defined(HAVE_HTTPCLIENT) && defined(HAVE_UPDATER)
+    UpdateManifest manifest;
+    {
+        HTTPClient http;
+        http.begin(m_httpbackend, String(F(SECRET_OTA_URL)));
+        int http_code = http.GET();
+        if (http_code < 200 || http_code >= 300 ||
+                !parse_manifest(http.getString().substring(0, 512), manifest)) {
+            LOG_WARN(NETWORK) << F("NetworkComponent: OTA manifest failure: HTTP/") <<  // (idefix)
+                http_code << F("\r\n");
+            http.end();
+            return;
+        }
+        http.end();
+    }
+    if (manifest.version == F(PE32HUD_VERSION)) {
+        return;
+    }
+    LOG_INFO(NETWORK) << F("NetworkComponent: OTA " PE32HUD_VERSION " -> ") <<  // (idefix)
+        manifest.version << F(" from ") << manifest.url << F("\r\n");
+    show_error(F("Updating to"), manifest.version);
+
+    HTTPClient http;
+    http.begin(m_httpbackend, manifest.url);
+    int http_code = http.GET();
+    bool ok = (http_code >= 200 && http_code < 300 &&
+               write_update(*http.getStreamPtr(), manifest));
+    http.end();
+    if (!ok) {
+        LOG_WARN(NETWORK) << F("NetworkComponent: OTA failed: HTTP/") << http_code << F("\r\n");
+        show_error(F("Update failed"), manifest.version);
+        return;
+    }
+    LOG_INFO(NETWORK) << F("NetworkComponent: OTA done, restarting\r\n");
+    Log.drain();
+    delay(100);
+    ESP.restart();
+#endif
+}
+
+bool NetworkComponent::parse_manifest(const String& packet, UpdateManifest& res)
+{
+    // Same line based "key:value" format as the HUD payload.
+    int start = 0;
+    bool done = false;
+
+    res.size = 0;
+    res.md5 = String();
+
+    while (!done) {
+        String line;
+        int lf = packet.indexOf('\n', start);
+        if (lf < 0) {
+            line = packet.substring(start);
+            done = true;
+        } else {
+            line = packet.substring(start, lf);
+            start = lf + 1;
+        }
+
+        if (starts_with_P(line, PSTR("version:"))) {
+            res.version = line.substring(8);
+        } else if (starts_with_P(line, PSTR("url:"))) {
+            res.url = line.substring(4);
+        } else if (starts_with_P(line, PSTR("size:"))) {
+            res.size = strtoul(line.c_str() + 5, NULL, 10);
+        } else if (starts_with_P(line, PSTR("md5:"))) {
+            res.md5 = line.substring(4);
         }
     }
+    return res.version.length() && res.url.length() && res.size && res.md5.length() == 32;
 }
 
-void NetworkComponent::handle_remote(const RemoteResult& res)
+#ifdef HAVE_UPDATER
+bool NetworkComponent::write_update(Stream& in, const UpdateManifest& manifest)
 {
-    Device.set_text(res.message0, res.message1, res.color);
-    Device.add_action(res.sunscreen);
+    // The image is written as-is into the spare flash slot, through a
+    // small fixed buffer. On the ESP8266 a gzip compressed image (made
+    // with "gzip -9 pe32hud.ino.bin") is uncompressed by the bootloader
+    // when it is activated, so we only transfer and write the compressed
+    // size (and the md5 is of the compressed file). The ESP32 Updater
+    // does not do that; serve it a plain image.
+    //
+    // This blocks the calling loop() until done: without HAVE_DUALCORE
+    // the sensors, LEDs and display stand still for the download. It is
+    // bounded by UPDATE_MAX_MS (and UPDATE_STALL_MS without data), and
+    // check_update() is not started over a degraded link.
+    uint8_t buf[512];
+    size_t written = 0;
+    unsigned long start = millis();
+    unsigned long lastdata = start;
+
+    if (!Update.begin(manifest.size) || !Update.setMD5(manifest.md5.c_str())) {
+        LOG_WARN(NETWORK) << F("NetworkComponent: OTA begin failed: ") <<  // (idefix)
+            Update.getError() << F("\r\n");
+        Update.end();
+        return false;
+    }
+    while (written < manifest.size && (millis() - start) < UPDATE_MAX_MS) {
+        size_t len = 0;
+        while (len < sizeof(buf) && written + len < manifest.size && in.available() > 0) {
+            buf[len++] = in.read();
+        }
+        if (!len) {
+            if ((millis() - lastdata) >= UPDATE_STALL_MS) {
+                break;
+            }
+            delay(1);
+            continue;
+        }
+        if (Update.write(buf, len) != len) {
+            break;
+        }
+        written += len;
+        lastdata = millis();
+    }
+    if (written != manifest.size) {
+        LOG_WARN(NETWORK) << F("NetworkComponent: OTA download failed: ") <<  // (idefix)
+            written << F("/") << manifest.size << F(" bytes in ") <<  // (idefix)
+            (millis() - start) << F(" ms\r\n");
+        Update.end();  // incomplete: discards the image
+        return false;
+    }
+    // Checks the md5 before it activates the image.
+    if (!Update.end()) {
+        LOG_WARN(NETWORK) << F("NetworkComponent: OTA verify failed: ") <<  // (idefix)
+            Update.getError() << F("\r\n");
+        return false;
+    }
+    return true;
 }
+#endif
@@ -4,6 +4,20 @@
 #include "pe32hud.h"
 
 #include "Device.h"
+#include "HudSources.h"
+#include "LinkQuality.h"
+
+// Resume the MQTT session on reconnect, instead of starting a clean one.
+// The broker then keeps our session state under the (stable) client id.
+#ifndef MQTT_PERSISTENT_SESSION
+#define MQTT_PERSISTENT_SESSION 1
+#endif
+
+// Serve the Metrics (see Metrics.h) on http://<device>:METRICS_PORT/metrics
+// for Prometheus to scrape. 0 leaves the port closed.
+#ifndef METRICS_PORT
+#define METRICS_PORT 9100
+#endif
 
 class NetworkComponent {
 #ifdef TEST_BUILD
@@ -11,17 +25,65 @@ class NetworkComponent {
 #endif
 
 public:
+    /* The HUD document is a list of "key:value" lines:
+     *
+     *   version:42             (optional, first) server version
+     *   base:40                (optional, after version) delta against 40
+     *   color:#00ff68
+     *   line0: -814 W    39 ms
+     *   line1:^11.981  v 5.637
+     *   action:UP              (UP, DOWN or RESET)
+     *
+     * We poll with "?v=<our version>". A reply without base: is a full
+     * snapshot; fields it leaves out are reset. A reply with base: lists
+     * only the fields that changed since that version, and is ignored
+     * (and a snapshot requested next time) unless base: is ours. Servers
+     * that do not know about versions always send a snapshot. */
     struct RemoteResult {
         String message0;
         String message1;
         unsigned long color;
         enum Device::action sunscreen;
+        uint32_t version;           // 0 = none/unversioned
+
+        RemoteResult()
+            : color(Device::COLOR_YELLOW), sunscreen(Device::ACTION_SUNSCREEN_NONE),
+              version(0) {}
+    };
+    enum remote_change {
+        CHANGED_COLOR = 0x1,
+        CHANGED_LINE0 = 0x2,
+        CHANGED_LINE1 = 0x4,
+        CHANGED_ACTION = 0x8,
+        CHANGED_TEXT = CHANGED_COLOR | CHANGED_LINE0 | CHANGED_LINE1,
+        REMOTE_BAD_BASE = 0x80      // delta against a version we don't have
+    };
+    struct MqttStats {
+        unsigned long attempts;         // CONNECT attempts, all time
+        unsigned long failures;
+        unsigned long time_to_connect;  // ms, from drop to last CONNACK
+    };
+    struct UpdateManifest {
+        String version;
+        String url;
+        uint32_t size;
+        String md5;         // 32 hex digits, for Update.setMD5()
     };
 
 private:
     static constexpr unsigned long m_interval = 5000;
     unsigned long m_lastact;
     unsigned long m_wifidowntime;
+    int m_lasthttpcode;
+    static constexpr unsigned long m_update_interval = 3600000;  // 1h
+    unsigned long m_lastupdatecheck;
+    LinkQuality m_link;
+    HudSources m_sources;
+    static constexpr uint8_t NO_SOURCE = 0xff;  // before the first payload
+    RemoteResult m_remote;          // merged HUD state
+    uint8_t m_remotesource;         // where m_remote is from, or NO_SOURCE
+    bool m_remoteshown;             // false after we showed an error
+    bool m_remotestale;             // m_remote shown as stale
 #ifdef HAVE_ESPWIFI
     wl_status_t m_wifistatus;
     // NOTE: We need a WiFiClient for _each_ component that does network
@@ -31,6 +93,95 @@ private:
     WiFiClient m_httpbackend;
     WiFiClient m_mqttbackend;
     MqttClient m_mqttclient;
+
+    // QoS 1 publishes stay in this window until they have survived
+    // MQTT_ACK_MS on a live session; after a drop they are resent with
+    // the DUP flag. (ArduinoMqttClient handles the PUBACK in poll() but
+    // does not tell us, hence the timer.)
+    struct Outgoing {
+        const __FlashStringHelper* topic;
+        String formdata;
+        unsigned long sent;
+        bool inflight;
+        bool dup;
+    };
+    static constexpr uint8_t MQTT_WINDOW = 4;
+    static constexpr unsigned long MQTT_ACK_MS = 2000;
+    Outgoing m_outbox[MQTT_WINDOW];
+    uint8_t m_noutbox;
+
+    // The (re)connect runs as a state machine from loop(), one step per
+    // pass. Only the CONNECT itself blocks, for at most MQTT_DEADLINE.
+    // Failed attempts back off exponentially; the wait is randomized per
+    // device so a fleet does not reconnect in lockstep after a broker
+    // restart.
+    enum mqtt_state {
+        MQTT_DOWN,          // start a new (re)connect
+        MQTT_WAIT,          // backing off
+        MQTT_RESOLVE,
+        MQTT_CONNECT,
+        MQTT_UP
+    };
+    static constexpr unsigned long MQTT_BACKOFF_MIN = 1000;
+    static constexpr unsigned long MQTT_BACKOFF_MAX = 300000;  // 5min
+    static constexpr unsigned long MQTT_DEADLINE = 3000;
+    enum mqtt_state m_mqttstate;
+    uint8_t m_mqttfailures;         // consecutive, for the backoff
+    uint16_t m_mqtttries;           // since the connection went down
+    unsigned long m_mqttwait;
+    unsigned long m_mqttsince;      // start of the wait
+    unsigned long m_mqttdownsince;
+    uint32_t m_jitter;              // xorshift32 state, seeded from the GUID
+    MqttStats m_mqttstats;
+
+    // Skip the DNS lookup on reconnect; re-resolve after the TTL or a
+    // failed connect.
+    static constexpr unsigned long BROKER_TTL = 3600000;  // 1h
+    IPAddress m_brokerip;
+    unsigned long m_brokerresolved;
+    bool m_brokercached;
+
+    // Roaming: when the link degrades, scan in the background and move
+    // to an AP of our SSID that is ROAM_MARGIN stronger. At most one scan
+    // per ROAM_HOLDOFF, so we don't flap between two APs. The before and
+    // after numbers are published once the new link has settled. The
+    // disconnect of the move itself is not a WiFi error for
+    // ROAM_CONNECT_MS; only after that do we start over without the
+    // BSSID.
+    enum roam_state {
+        ROAM_IDLE,
+        ROAM_SCANNING,
+        ROAM_SETTLING
+    };
+    static constexpr int8_t ROAM_MARGIN = 8;                // dB
+    static constexpr unsigned long ROAM_HOLDOFF = 600000;   // 10min
+    static constexpr uint8_t ROAM_SETTLE_TICKS = 6;         // 30s
+    static constexpr unsigned long ROAM_CONNECT_MS = 15000;
+    enum roam_state m_roamstate;
+    bool m_scanned;
+    unsigned long m_lastscan;
+    uint8_t m_roamticks;
+    unsigned long m_roamsince;      // WiFi.begin() of the move
+    uint8_t m_roamfrom[6];
+    uint8_t m_roamto[6];
+    int8_t m_roamrssi;
+    unsigned long m_roamlatency;
+    bool m_roamhadlatency;          // m_roamlatency is a measurement
+
+#if METRICS_PORT
+    // The metrics endpoint: one client at a time, read and answered from
+    // loop() without waiting on it. The body is rendered into a fixed
+    // buffer, so a scrape does not touch the heap.
+    static constexpr unsigned long METRICS_TIMEOUT = 1000;
+    static constexpr size_t METRICS_BUFFER_SIZE = 2048;
+    WiFiServer m_metricsserver;
+    WiFiClient m_metricsclient;
+    unsigned long m_metricssince;   // accepted at
+    char m_metricsreq[16];          // start of the request line
+    uint8_t m_metricsreqlen;
+    uint8_t m_metricseol;           // line ends in a row, 2 ends the headers
+    char m_metricsbuf[METRICS_BUFFER_SIZE];
+#endif
 #endif
 
 public:
@@ -39,7 +190,10 @@ public:
     void setup();
     void loop();
 
-    void push_remote(String topic, String formdata);
+    void push_remote(const __FlashStringHelper* topic, const String& formdata);
+#ifdef HAVE_ESPWIFI
+    const MqttStats& get_mqtt_stats() const { return m_mqttstats; }
+#endif
 
 private:
 #ifdef HAVE_ESPWIFI
@@ -47,12 +201,35 @@ private:
 #endif
 
     void ensure_mqtt();
+#ifdef HAVE_ESPWIFI
+    void step_roam();
+    bool is_roaming() const {
+        return m_roamstate == ROAM_SETTLING && (millis() - m_roamsince) < ROAM_CONNECT_MS;
+    }
+    void report_roam();
+    void step_mqtt();
+    void backoff_mqtt();
+    bool resolve_broker();
+    void flush_outbox();
+    bool publish(Outgoing& out);
+#if METRICS_PORT
+    void step_metrics();
+    void answer_metrics();
+#endif
+#endif
     void sample();
 
     String fetch_remote();
 
-    static void parse_remote(const String& remote_packet, RemoteResult& res);
-    void handle_remote(const RemoteResult& res);
+    static uint8_t parse_remote(const String& remote_packet, RemoteResult& res);
+    void handle_remote(const RemoteResult& res, uint8_t changed);
+    void show_error(const String& msg0, const String& msg1);
+
+    void check_update();
+    static bool parse_manifest(const String& packet, UpdateManifest& res);
+#ifdef HAVE_UPDATER
+    static bool write_update(Stream& in, const UpdateManifest& manifest);
+#endif
 };
 
 #endif //INCLUDED_PE32HUD_NETWORKCOMPONENT_H
@@ -43,18 +43,14 @@ void SunscreenComponent::handle_press_request() {
     Device.set_alert(Device::NOTIFY_SUNSCREEN);
     // TODO: something with flickering/blinking?
     // lcd.setColor(COLOR_YELLOW)?
-#ifdef DEBUG
-    Serial << F("  --SunscreenComponent: pressing ") << m_state << F("\r\n");
-#endif
+    LOG_DEBUG(SUNSCREEN) << F("  --SunscreenComponent: pressing ") << m_state << F("\r\n");
     press_at_most_one(m_state);
     m_state = static_cast<enum state>(m_state & ~REQUEST);
 }
 
 void SunscreenComponent::handle_depress() {
     Device.clear_alert(Device::NOTIFY_SUNSCREEN);
-#ifdef DEBUG
-    Serial << F("  --SunscreenComponent: depressing ") << m_state << F("\r\n");
-#endif
+    LOG_DEBUG(SUNSCREEN) << F("  --SunscreenComponent: depressing ") << m_state << F("\r\n");
     press_at_most_one(DEPRESSED);
     m_state = DEPRESSED;
 }
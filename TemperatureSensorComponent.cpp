@@ -1,46 +1,69 @@
 #include "TemperatureSensorComponent.h"
 
-#include <DHTesp.h>        // DHT_sensor_library_for_ESPx
+#include <math.h>          // isnan
 
 #include "Device.h"
 
 extern Device Device;
 
 TemperatureSensorComponent::TemperatureSensorComponent(uint8_t pin_dht11) :
-    m_dht11(new DHTesp), m_pin_dht11(pin_dht11)
+    m_epoch(UINT32_MAX), m_dht11(pin_dht11)
 {
 }
 
 void TemperatureSensorComponent::setup() {
     Device.set_alert(Device::INACTIVE_DHT11);
-    m_dht11->setup(m_pin_dht11, DHTesp::DHT11);
-    m_lastact = (millis() - m_interval);
+    m_dht11.setup();
     Device.clear_alert(Device::INACTIVE_DHT11);
 }
 
 void TemperatureSensorComponent::loop() {
-    if ((millis() - m_lastact) >= m_interval) {
-#ifdef DEBUG
-        Serial << F("  --TemperatureSensorComponent: sample\r\n");
-#endif
-        m_lastact = millis();
+    if (Device.get_epoch() != m_epoch) {
+        LOG_DEBUG(TEMPERATURE) << F("  --TemperatureSensorComponent: sample\r\n");
+        m_epoch = Device.get_epoch();
+        m_dht11.start();
+    }
+    if (m_dht11.loop()) {
         sample();
     }
 }
 
 void TemperatureSensorComponent::sample() {
-    float humidity = m_dht11->getHumidity();
-    float temperature = m_dht11->getTemperature();
+    float humidity = m_dht11.get_humidity();
+    float temperature = m_dht11.get_temperature();
 
     // Print values
-    Serial << F("DHT11:  ") <<                         // (comment for Arduino IDE)
-        m_dht11->getStatusString() << F(" status,  ") <<  // "OK"
+    LOG_INFO(TEMPERATURE) << F("DHT11:  ") <<                         // (comment for Arduino IDE)
+        m_dht11.get_status_string() << F(" status,  ") <<  // "OK"
         temperature << F(" 'C,  ") <<                    // (comment for Arduino IDE)
         humidity << F(" phi(RH)\r\n");                   // (comment for Arduino IDE)
 
+    // All tries failed: blink, until the next read succeeds.
+    if (m_dht11.get_status() != Dht11Reader::STATUS_OK) {
+        Device.set_alert(Device::INACTIVE_DHT11);
+    } else {
+        Device.clear_alert(Device::INACTIVE_DHT11);
+    }
+    if (!isnan(temperature)) {
+        Device.set_reading(Device::READING_TEMP, temperature);
+    }
+    if (!isnan(humidity)) {
+        Device.set_reading(Device::READING_HUMIDITY, humidity);
+    }
+
     // Publish values
-    Device.publish("pe32/hud/temp/xwwwform", (
-        String("status=") + m_dht11->getStatusString() +
-        String("&temperature=") + temperature +
-        String("&humidity=") + humidity));
+    String formdata;
+    formdata.reserve(48);
+    formdata += F("status=");
+    formdata += m_dht11.get_status_string();
+    // Without a good read there is nothing to send but the status.
+    if (!isnan(temperature)) {
+        formdata += F("&temperature=");
+        formdata += temperature;
+    }
+    if (!isnan(humidity)) {
+        formdata += F("&humidity=");
+        formdata += humidity;
+    }
+    Device.telemetry(Device::SENSOR_DHT11, m_epoch, F("pe32/hud/temp/xwwwform"), formdata);
 }
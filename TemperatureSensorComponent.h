@@ -3,16 +3,17 @@
 
 #include "pe32hud.h"
 
-class DHTesp;
+#include "Dht11Reader.h"
 
 class TemperatureSensorComponent {
+#ifdef TEST_BUILD
+    friend int main(int argc, char** argv);
+#endif
+
 private:
-    static constexpr unsigned long m_interval = 30000;
-    unsigned long m_lastact;
+    uint32_t m_epoch;           // of the last sample (see Device)
     // FIXME: use SimpleKalmanFilter here (and eco2)
-    DHTesp* m_dht11;
-
-    const uint8_t m_pin_dht11;
+    Dht11Reader m_dht11;
 
 public:
     TemperatureSensorComponent(uint8_t pin_dht11);
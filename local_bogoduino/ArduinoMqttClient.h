@@ -3,20 +3,94 @@
 
 /* This requires WiFi includes. But they are handled elsewhere, we hope. */
 
+/* Local broker stand-in. A message is "on the wire" after endMessage()
+ * and reaches the broker on the next poll(); set_link(false) loses
+ * whatever is on the wire, like a link flap would. The counters tell
+ * what arrived. Set refuse to refuse the next N connects, and
+ * connect_ms to take that long (in delay()) for the CONNACK. */
 struct MqttClient {
+    bool clean_session = true;
+    bool link_up = true;
+    bool is_connected = false;
+    bool has_session = false;   // broker keeps state for our client id
+    bool message_dup = false;
+    unsigned refuse = 0;
+    unsigned long connect_ms = 0;
+    unsigned long timeout = 30000;
+    int error = 0;
+
+    unsigned connects = 0;      // CONNECT attempts
+    unsigned resumed = 0;       // ... that found a persistent session
+    unsigned on_wire = 0;
+    unsigned delivered = 0;
+    unsigned resent = 0;        // messages with the DUP flag
+    unsigned lost = 0;
+    String topic;               // of the last message
+    String message;
+
     MqttClient(WiFiClient& wifi_client) {}
 
     void setId(const String& id) {}
+    void setCleanSession(bool value) { clean_session = value; }
+    void setConnectionTimeout(unsigned long value) { timeout = value; }
+
+    int connect(IPAddress ip, uint16_t port) { return connect(); }
+    int connect(const char* host, uint16_t port) { return connect(); }
+    void poll() {
+        if (is_connected) {
+            delivered += on_wire;
+            on_wire = 0;
+        }
+    }
+    int connected() const { return is_connected; }
+    int connectError() const { return error; }
 
-    bool connect(const String& host, uint16_t port) { return true; }
-    void poll() {}
-    bool connected() const { return true; }
-    const char* connectError() { return "some error"; }
+    int beginMessage(const String& topic_, bool retain = false, uint8_t qos = 0, bool dup = false) {
+        topic = topic_;
+        message = "";
+        message_dup = dup;
+        return 1;
+    }
+    void print(const String& message_) { message += message_; }
+    int endMessage() {
+        if (!is_connected) {
+            return 0;
+        }
+        on_wire += 1;
+        resent += message_dup;
+        return 1;
+    }
 
-    void beginMessage(const String& topic) {}
-    void print(const String& message) {}
-    void endMessage() {}
+    // Test hook
+    void set_link(bool up) {
+        link_up = up;
+        if (!up && is_connected) {
+            lost += on_wire;
+            on_wire = 0;
+            is_connected = false;
+        }
+    }
+
+private:
+    int connect() {
+        connects += 1;
+        if (!link_up || refuse) {
+            refuse -= (refuse > 0);
+            error = -2;         // MQTT_CONNECTION_REFUSED
+            return 0;
+        }
+        if (connect_ms > timeout) {
+            delay(timeout);
+            error = -1;         // MQTT_CONNECTION_TIMEOUT
+            return 0;
+        }
+        delay(connect_ms);
+        error = 0;
+        is_connected = true;
+        resumed += has_session;
+        has_session = !clean_session;
+        return 1;
+    }
 };
 
 #endif //INCLUDED_LOCAL_BOGODUINO_ARDUINOMQTTCLIENT_H
-
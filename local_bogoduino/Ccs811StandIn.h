@@ -0,0 +1,60 @@
+#ifndef INCLUDED_LOCAL_BOGODUINO_CCS811STANDIN_H
+#define INCLUDED_LOCAL_BOGODUINO_CCS811STANDIN_H
+
+#include <I2CStandIn.h>
+
+/* Register-level CCS811 on the test Wire (see i2c/Wire.h): a write sets
+ * the register, a read serves ALG_RESULT_DATA (0x02) or BASELINE (0x11)
+ * and NACKs any other. status is what the sensor reports in the result
+ * block: 0x98 is FW_MODE|APP_VALID|DATA_READY, 0x90 is "no new data",
+ * 0x91 is an error with error_id. */
+struct Ccs811StandIn : public I2CStandIn {
+    uint16_t eco2;
+    uint16_t tvoc;
+    uint16_t baseline;
+    uint8_t status;
+    uint8_t error_id;
+    uint8_t reg;
+    unsigned result_reads;
+    unsigned baseline_reads;
+
+    Ccs811StandIn(uint16_t eco2_, uint16_t tvoc_, uint16_t baseline_) :
+        eco2(eco2_), tvoc(tvoc_), baseline(baseline_), status(0x98), error_id(0),
+        reg(0), result_reads(0), baseline_reads(0) {}
+
+    void attach(TwoWire& wire, uint8_t addr = CCS811_ADDRESS) {
+        wire.attach(addr, this);
+    }
+
+    virtual bool on_write(const uint8_t* buf, size_t len) {
+        if (len) {
+            reg = buf[0];
+        }
+        return true;
+    }
+
+    virtual bool on_read(uint8_t* buf, size_t len) {
+        uint8_t regs[8];
+        uint8_t size;
+        if (reg == 0x02) {
+            regs[0] = eco2 >> 8; regs[1] = eco2;
+            regs[2] = tvoc >> 8; regs[3] = tvoc;
+            regs[4] = status; regs[5] = error_id;
+            regs[6] = 0x04; regs[7] = 0x0d;  // RAW_DATA: 1uA, 13 ADC
+            size = 8;
+            result_reads += 1;
+        } else if (reg == 0x11) {
+            regs[0] = baseline >> 8; regs[1] = baseline;
+            size = 2;
+            baseline_reads += 1;
+        } else {
+            return false;
+        }
+        for (size_t i = 0; i < len; ++i) {
+            buf[i] = (i < size ? regs[i] : 0xff);
+        }
+        return true;
+    }
+};
+
+#endif //INCLUDED_LOCAL_BOGODUINO_CCS811STANDIN_H
@@ -0,0 +1,64 @@
+#ifndef INCLUDED_LOCAL_BOGODUINO_DHT11STANDIN_H
+#define INCLUDED_LOCAL_BOGODUINO_DHT11STANDIN_H
+
+/* Synthetic DHT11: when the Dht11Reader releases the line, feed it the
+ * falling edges of a response, as its edge interrupt would see them
+ * (with a few us of jitter). Set failures to have the next responses go
+ * wrong: mute (no edges), flip_bit (checksum) or glitch (a spike in the
+ * middle of a bit). */
+struct Dht11StandIn {
+    enum failure { NONE, MUTE, FLIP_BIT, GLITCH };
+
+    uint8_t data[4];            // RH int, RH dec, T int, T dec
+    enum failure failure;
+    unsigned failures;          // this many responses fail, then good ones
+    unsigned responses;
+
+    Dht11StandIn(uint8_t humidity, float temperature) :
+        failure(NONE), failures(0), responses(0) { set(humidity, temperature); }
+
+    void set(uint8_t humidity, float temperature) {
+        int tenths = static_cast<int>(temperature * 10 + (temperature < 0 ? -0.5 : 0.5));
+        bool negative = (tenths < 0);
+        tenths = (negative ? -tenths : tenths);
+        data[0] = humidity;
+        data[1] = 0;
+        data[2] = tenths / 10;
+        data[3] = (tenths % 10) | (negative ? 0x80 : 0);
+    }
+
+    void attach(Dht11Reader& reader) {
+        reader.set_responder(&respond, this);
+    }
+
+    static void respond(void* ctx, Dht11Reader& reader) {
+        Dht11StandIn& self = *static_cast<Dht11StandIn*>(ctx);
+        enum failure fail = (self.failures ? self.failure : NONE);
+        self.responses += 1;
+        if (self.failures) {
+            self.failures -= 1;
+        }
+        if (fail == MUTE) {
+            return;
+        }
+        uint8_t bytes[5] = {self.data[0], self.data[1], self.data[2], self.data[3], 0};
+        bytes[4] = bytes[0] + bytes[1] + bytes[2] + bytes[3];
+        if (fail == FLIP_BIT) {
+            bytes[2] ^= 0x04;
+        }
+        uint32_t us = micros() + 30;
+        reader.edge(us);                        // response: 80 low, 80 high
+        us += 160;
+        reader.edge(us);
+        for (uint8_t i = 0; i < 40; ++i) {
+            bool one = bytes[i / 8] & (0x80 >> (i % 8));
+            if (fail == GLITCH && i == 20) {
+                reader.edge(us + 20);           // a spike in the low part
+            }
+            us += 50 + (one ? 70 : 27) + (i % 5) - 2;
+            reader.edge(us);
+        }
+    }
+};
+
+#endif //INCLUDED_LOCAL_BOGODUINO_DHT11STANDIN_H
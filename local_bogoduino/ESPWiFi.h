@@ -21,22 +21,137 @@ typedef enum {
     WL_DISCONNECTED     = 7
 } wl_status_t;
 
+/* ESP8266WiFiScan.h */
+#define WIFI_SCAN_RUNNING (-1)
+#define WIFI_SCAN_FAILED (-2)
+
+/* IPAddress.h */
+struct IPAddress {
+    uint8_t bytes[4];
+    IPAddress() : bytes{0, 0, 0, 0} {}
+    IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : bytes{a, b, c, d} {}
+    String toString() const {
+        return String(bytes[0]) + "." + String(bytes[1]) + "." +
+            String(bytes[2]) + "." + String(bytes[3]);
+    }
+};
+
 struct WiFiClient {
-    wl_status_t status() { return WL_CONNECTED; }
+    wl_status_t status() {
+        if (down) {
+            down -= 1;
+            return WL_DISCONNECTED;
+        }
+        return WL_CONNECTED;
+    }
     void mode(WiFiMode_t mode) {}
     void persistent(bool value) {}
     void setAutoReconnect(bool value) {}
+    void setTimeout(unsigned long timeout) {}
 
-    void begin(const String &ssid, const String &password, int32_t channel = 0, const uint8_t* bssid = NULL, bool connect = true) {}
+    void begin(const String &ssid, const String &password, int32_t channel = 0, const uint8_t* bssid = NULL, bool connect = true) {
+        for (uint8_t i = 0; bssid && i < naps; ++i) {
+            if (memcmp(aps[i].bssid, bssid, 6) == 0) {
+                current = i;
+                down = movedown;
+            }
+        }
+        plainbegins += !bssid;
+    }
     void disconnect(bool val1, bool val2) {}
     uint8_t waitForConnectResult(unsigned long delay = 60000) { return WL_CONNECTED; }
     char const* macAddress() const { return "11:22:33:44:55:66"; }
     unsigned char const* const BSSID() const {
 	static unsigned char const buf[6] = {0xc0, 0xff, 0xee, 0xc0, 0xff, 0xee};
-	return buf; }
-    int32_t RSSI() { return -64; }
+	return naps ? aps[current].bssid : buf; }
+    int32_t RSSI() { return naps ? aps[current].rssi : -64; }
+
+    /* The APs around us, and which one we are on (when naps > 0). A scan
+     * "runs" for one scanComplete() call. */
+    struct Ap {
+        const char* ssid;
+        uint8_t bssid[6];
+        int32_t rssi;
+        int32_t channel;
+    };
+    Ap aps[4];
+    uint8_t naps = 0;
+    uint8_t current = 0;
+    /* A move to another AP (begin() with a BSSID) is disconnected for
+     * movedown status() calls. */
+    unsigned movedown = 0;
+    unsigned down = 0;
+    unsigned plainbegins = 0;
+    unsigned scans = 0;
+    int8_t scanning = WIFI_SCAN_FAILED;
+    int8_t scanNetworks(bool async = false, bool show_hidden = false) {
+        scans += 1;
+        scanning = WIFI_SCAN_RUNNING;
+        return async ? WIFI_SCAN_RUNNING : naps;
+    }
+    int8_t scanComplete() {
+        int8_t ret = scanning;
+        scanning = (scanning == WIFI_SCAN_RUNNING ? naps : scanning);
+        return ret;
+    }
+    void scanDelete() { scanning = WIFI_SCAN_FAILED; }
+    String SSID(uint8_t i) const { return aps[i].ssid; }
+    int32_t RSSI(uint8_t i) const { return aps[i].rssi; }
+    const uint8_t* BSSID(uint8_t i) const { return aps[i].bssid; }
+    int32_t channel(uint8_t i) const { return aps[i].channel; }
+
+    unsigned lookups = 0;
+    int hostByName(const char* host, IPAddress& ip) {
+        lookups += 1;
+        ip = IPAddress(127, 0, 0, 1);
+        return 1;
+    }
 
     void printDiag(Print &p) {}
+
+    /* A TCP connection (from the WiFiServer below): read() takes from
+     * the request, write() adds to the response. */
+    struct Peer {
+        String request;
+        unsigned pos = 0;
+        String response;
+        bool open = true;
+    };
+    Peer* peer = NULL;
+    explicit operator bool() const { return peer && peer->open; }
+    bool connected() const { return peer && peer->open; }
+    int available() const { return peer ? peer->request.length() - peer->pos : 0; }
+    int read() { return available() > 0 ? peer->request[peer->pos++] : -1; }
+    size_t write(const uint8_t* buf, size_t len) {
+        for (size_t i = 0; peer && i < len; ++i) {
+            peer->response += static_cast<char>(buf[i]);
+        }
+        return peer ? len : 0;
+    }
+    void stop() {
+        if (peer) {
+            peer->open = false;
+        }
+    }
+};
+
+/* Listens once begin() is called; accept() hands out the pending
+ * connection, if any. */
+struct WiFiServer {
+    uint16_t port;
+    bool listening = false;
+    WiFiClient::Peer* pending = NULL;
+
+    WiFiServer(uint16_t port) : port(port) {}
+    void begin() { listening = true; }
+    WiFiClient accept() {
+        WiFiClient client;
+        if (listening) {
+            client.peer = pending;
+            pending = NULL;
+        }
+        return client;
+    }
 };
 
 extern WiFiClient WiFi;
@@ -0,0 +1,5 @@
+#include <Arduino.h>
+#include <ESPWiFi.h>
+#include <HTTPClient.h>
+
+HttpServers HttpServer;
@@ -0,0 +1,97 @@
+#ifndef INCLUDED_LOCAL_BOGODUINO_HTTPCLIENT_H
+#define INCLUDED_LOCAL_BOGODUINO_HTTPCLIENT_H
+
+/* HTTPClient: GET() goes to the HttpServers route whose prefix matches
+ * the URL, so a test decides which servers are up and what they say. A
+ * URL without a route (or with a route that is down) fails like an
+ * unreachable host. Each route counts its requests and keeps the last
+ * URL, and can take ms to answer (through delay(), so millis() moves
+ * on). */
+
+#include <HttpStandIn.h>
+
+#define HTTPC_ERROR_CONNECTION_REFUSED (-1)
+
+struct HttpServers {
+    // The body of the reply to url, and its HTTP code.
+    typedef String (*respond_fn)(void* ctx, const String& url, int& code);
+
+    struct Route {
+        const char* prefix;
+        respond_fn respond;
+        void* ctx;
+        bool up;
+        unsigned long ms;
+        unsigned requests;
+        String lasturl;
+    };
+    static constexpr uint8_t MAX_ROUTES = 4;
+
+    Route routes[MAX_ROUTES];
+    uint8_t nroutes;
+
+    HttpServers() : nroutes(0) {}
+
+    Route& add(const char* prefix, respond_fn respond, void* ctx) {
+        Route& route = routes[nroutes++];
+        route.prefix = prefix;
+        route.respond = respond;
+        route.ctx = ctx;
+        route.up = true;
+        route.ms = 0;
+        route.requests = 0;
+        return route;
+    }
+    void clear() { nroutes = 0; }
+
+    Route* find(const String& url) {
+        for (uint8_t i = 0; i < nroutes; ++i) {
+            if (url.startsWith(routes[i].prefix)) {
+                return &routes[i];
+            }
+        }
+        return NULL;
+    }
+};
+
+extern HttpServers HttpServer;
+
+class HTTPClient {
+private:
+    String m_url;
+    String m_body;
+    HttpStandIn m_stream;
+
+public:
+    HTTPClient() : m_stream(NULL, 0) {}
+
+    bool begin(WiFiClient&, const String& url) { m_url = url; return true; }
+    void setTimeout(uint16_t) {}
+    void setConnectTimeout(int32_t) {}
+    void end() { m_body = String(); }
+
+    int GET() {
+        HttpServers::Route* route = HttpServer.find(m_url);
+        if (!route) {
+            return HTTPC_ERROR_CONNECTION_REFUSED;
+        }
+        route->requests += 1;
+        route->lasturl = m_url;
+        if (route->ms) {
+            delay(route->ms);
+        }
+        if (!route->up) {
+            return HTTPC_ERROR_CONNECTION_REFUSED;
+        }
+        int code = 200;
+        m_body = route->respond(route->ctx, m_url, code);
+        return code;
+    }
+    String getString() { return m_body; }
+    Stream* getStreamPtr() {
+        m_stream = HttpStandIn(reinterpret_cast<const uint8_t*>(m_body.c_str()), m_body.length());
+        return &m_stream;
+    }
+};
+
+#endif //INCLUDED_LOCAL_BOGODUINO_HTTPCLIENT_H
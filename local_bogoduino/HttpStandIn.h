@@ -0,0 +1,38 @@
+#ifndef INCLUDED_LOCAL_BOGODUINO_HTTPSTANDIN_H
+#define INCLUDED_LOCAL_BOGODUINO_HTTPSTANDIN_H
+
+/* Stand-in for a local HTTP server: serves a response body from memory
+ * like HTTPClient::getStreamPtr() does, at most chunk bytes at a time
+ * (as if they arrived in separate TCP segments). */
+
+struct HttpStandIn : public Stream {
+    const uint8_t* body;
+    size_t len;
+    size_t pos;
+    size_t chunk;
+    size_t avail;
+
+    HttpStandIn(const uint8_t* body_, size_t len_, size_t chunk_ = 1460)
+        : body(body_), len(len_), pos(0), chunk(chunk_), avail(0) {}
+
+    virtual int available() {
+        if (!avail) {
+            avail = (len - pos < chunk ? len - pos : chunk);
+        }
+        return avail;
+    }
+    virtual int read() {
+        if (pos >= len) {
+            return -1;
+        }
+        if (avail) {
+            --avail;
+        }
+        return body[pos++];
+    }
+    virtual int peek() { return pos < len ? body[pos] : -1; }
+    virtual size_t write(uint8_t) { return 0; }
+    virtual void flush() {}
+};
+
+#endif //INCLUDED_LOCAL_BOGODUINO_HTTPSTANDIN_H
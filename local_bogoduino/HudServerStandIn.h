@@ -0,0 +1,58 @@
+#ifndef INCLUDED_LOCAL_BOGODUINO_HUDSERVERSTANDIN_H
+#define INCLUDED_LOCAL_BOGODUINO_HUDSERVERSTANDIN_H
+
+/* Reference HUD server for the versioned protocol (see
+ * NetworkComponent::RemoteResult). Every set() makes a new version; the
+ * last few versions are kept, so reply(v) can list only the fields that
+ * changed since v, or send a full snapshot when v is unknown or too
+ * old. serve() puts it behind a URL for the HTTPClient stand-in. */
+
+struct HudServerStandIn {
+    enum { COLOR, LINE0, LINE1, ACTION, NUM_FIELDS };
+    static constexpr uint32_t HISTORY = 4;
+
+    String fields[HISTORY][NUM_FIELDS];     // by version % HISTORY
+    uint32_t version;
+
+    HudServerStandIn() : version(0) {}
+
+    void set(int field, const String& value) {
+        String* prev = fields[version % HISTORY];
+        version += 1;
+        String* cur = fields[version % HISTORY];
+        for (int i = 0; i < NUM_FIELDS; ++i) {
+            cur[i] = prev[i];
+        }
+        cur[field] = value;
+    }
+
+    String reply(uint32_t since) const {
+        static const char* const keys[NUM_FIELDS] = {
+            "color:", "line0:", "line1:", "action:"};
+        const String* cur = fields[version % HISTORY];
+        bool delta = (since && since <= version && version - since < HISTORY);
+        String ret = String("version:") + version;
+        if (delta) {
+            ret += String("\nbase:") + since;
+        }
+        for (int i = 0; i < NUM_FIELDS; ++i) {
+            if (!delta || cur[i] != fields[since % HISTORY][i]) {
+                ret += String("\n") + keys[i] + cur[i];
+            }
+        }
+        return ret;
+    }
+
+    HttpServers::Route& serve(const char* prefix) {
+        return HttpServer.add(prefix, &respond, this);
+    }
+
+    static String respond(void* ctx, const String& url, int& code) {
+        int v = url.indexOf("v=");
+        code = 200;
+        return static_cast<HudServerStandIn*>(ctx)->reply(
+            v < 0 ? 0 : strtoul(url.c_str() + v + 2, NULL, 10));
+    }
+};
+
+#endif //INCLUDED_LOCAL_BOGODUINO_HUDSERVERSTANDIN_H
@@ -0,0 +1,18 @@
+#ifndef INCLUDED_LOCAL_BOGODUINO_I2CSTANDIN_H
+#define INCLUDED_LOCAL_BOGODUINO_I2CSTANDIN_H
+
+/* A device on the test Wire (see i2c/Wire.h), attach()ed at its
+ * address. This one ACKs everything and reads as 0xff. */
+struct I2CStandIn {
+    virtual ~I2CStandIn() {}
+    // A write transaction (usually a register and its data); false
+    // for a NACK.
+    virtual bool on_write(const uint8_t* buf, size_t len) { return true; }
+    // A read transaction of len bytes; false for a NACK.
+    virtual bool on_read(uint8_t* buf, size_t len) {
+        memset(buf, 0xff, len);
+        return true;
+    }
+};
+
+#endif //INCLUDED_LOCAL_BOGODUINO_I2CSTANDIN_H
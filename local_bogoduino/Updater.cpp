@@ -0,0 +1,63 @@
+#include <Arduino.h>
+#include <Updater.h>
+
+#include <math.h>
+#include <stdio.h>
+
+UpdaterClass Update;
+
+// RFC 1321, the short way.
+void md5_hex(const uint8_t* buf, size_t len, char out[33])
+{
+    static const uint8_t r[64] = {
+        7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22,
+        5, 9, 14, 20, 5, 9, 14, 20, 5, 9, 14, 20, 5, 9, 14, 20,
+        4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23,
+        6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21};
+    uint32_t k[64];
+    for (int i = 0; i < 64; ++i) {
+        k[i] = static_cast<uint32_t>(fabs(sin(i + 1)) * 4294967296.0);
+    }
+    uint32_t h[4] = {0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476};
+
+    size_t total = ((len + 8) / 64 + 1) * 64;
+    for (size_t off = 0; off < total; off += 64) {
+        uint32_t w[16] = {0};
+        for (size_t i = 0; i < 64; ++i) {
+            size_t pos = off + i;
+            uint8_t byte = 0;
+            if (pos < len) {
+                byte = buf[pos];
+            } else if (pos == len) {
+                byte = 0x80;
+            } else if (pos >= total - 8) {
+                byte = static_cast<uint8_t>((static_cast<uint64_t>(len) * 8) >> (8 * (pos - (total - 8))));
+            }
+            w[i / 4] |= static_cast<uint32_t>(byte) << (8 * (i % 4));
+        }
+        uint32_t a = h[0], b = h[1], c = h[2], d = h[3];
+        for (int i = 0; i < 64; ++i) {
+            uint32_t f;
+            int g;
+            if (i < 16) {
+                f = (b & c) | (~b & d); g = i;
+            } else if (i < 32) {
+                f = (d & b) | (~d & c); g = (5 * i + 1) % 16;
+            } else if (i < 48) {
+                f = b ^ c ^ d; g = (3 * i + 5) % 16;
+            } else {
+                f = c ^ (b | ~d); g = (7 * i) % 16;
+            }
+            uint32_t tmp = d;
+            d = c;
+            c = b;
+            uint32_t x = a + f + k[i] + w[g];
+            b = b + ((x << r[i]) | (x >> (32 - r[i])));
+            a = tmp;
+        }
+        h[0] += a; h[1] += b; h[2] += c; h[3] += d;
+    }
+    for (int i = 0; i < 16; ++i) {
+        sprintf(out + 2 * i, "%02x", (h[i / 4] >> (8 * (i % 4))) & 0xff);
+    }
+}
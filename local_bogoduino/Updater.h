@@ -0,0 +1,75 @@
+#ifndef INCLUDED_LOCAL_BOGODUINO_UPDATER_H
+#define INCLUDED_LOCAL_BOGODUINO_UPDATER_H
+
+/* Updater.h: writes "flash" to RAM, so we can check what was written.
+ * Like the ESP cores, end() refuses an image whose MD5 does not match
+ * the one given to setMD5(). */
+
+#define UPDATE_ERROR_OK 0
+#define UPDATE_ERROR_SIZE 4
+#define UPDATE_ERROR_MD5 7
+
+// Lowercase hex MD5 of buf into out[33].
+void md5_hex(const uint8_t* buf, size_t len, char out[33]);
+
+struct UpdaterClass {
+    uint8_t* image;
+    size_t size;
+    size_t written;
+    bool active;
+    bool done;
+    char md5[33];
+    uint8_t error;
+
+    UpdaterClass() : image(NULL), size(0), written(0), active(false), done(false),
+        md5(), error(UPDATE_ERROR_OK) {}
+
+    bool begin(size_t sz) {
+        free(image);
+        image = static_cast<uint8_t*>(malloc(sz));
+        size = sz; written = 0; active = (image != NULL); done = false;
+        md5[0] = '\0';
+        error = (active ? UPDATE_ERROR_OK : UPDATE_ERROR_SIZE);
+        return active;
+    }
+    bool setMD5(const char* expected) {
+        if (strlen(expected) != 32) {
+            return false;
+        }
+        for (uint8_t i = 0; i < 33; ++i) {
+            md5[i] = tolower(expected[i]);
+        }
+        return true;
+    }
+    size_t write(uint8_t* data, size_t len) {
+        if (!active || written + len > size) {
+            return 0;
+        }
+        memcpy(image + written, data, len);
+        written += len;
+        return len;
+    }
+    bool end(bool evenIfRemaining = false) {
+        done = active && (written == size || evenIfRemaining);
+        active = false;
+        if (!done) {
+            error = UPDATE_ERROR_SIZE;
+            return false;
+        }
+        char actual[33];
+        md5_hex(image, written, actual);
+        if (md5[0] && strcmp(md5, actual) != 0) {
+            error = UPDATE_ERROR_MD5;
+            done = false;
+        }
+        return done;
+    }
+    void abort() { active = false; }
+    uint8_t getError() { return error; }
+    // ESP8266 flash sectors are 4KiB.
+    size_t sectors_written() const { return (written + 4095) / 4096; }
+};
+
+extern UpdaterClass Update;
+
+#endif //INCLUDED_LOCAL_BOGODUINO_UPDATER_H
@@ -0,0 +1,36 @@
+#include <Wire.h>
+
+TwoWire Wire;
+
+uint8_t TwoWire::endTransmission(uint8_t sendStop)
+{
+    return twi_writeTo(m_txaddr, m_tx, m_txlen, sendStop);
+}
+
+uint8_t TwoWire::requestFrom(uint8_t addr, uint8_t len, uint8_t sendStop)
+{
+    if (len > BUFFER_LENGTH) {
+        len = BUFFER_LENGTH;
+    }
+    m_rxpos = 0;
+    m_rxlen = (twi_readFrom(addr, m_rx, len, sendStop) ? 0 : len);
+    return m_rxlen;
+}
+
+size_t TwoWire::write(uint8_t ch)
+{
+    if (m_txlen >= BUFFER_LENGTH) {
+        return 0;
+    }
+    m_tx[m_txlen++] = ch;
+    return 1;
+}
+
+size_t TwoWire::write(const uint8_t* buf, size_t len)
+{
+    size_t n = 0;
+    while (n < len && write(buf[n])) {
+        ++n;
+    }
+    return n;
+}
@@ -0,0 +1,67 @@
+#ifndef INCLUDED_LOCAL_BOGODUINO_I2C_WIRE_H
+#define INCLUDED_LOCAL_BOGODUINO_I2C_WIRE_H
+
+/* Replacement for Wire.h in the TEST_BUILD: a bus with register-level
+ * device stand-ins on it (see Ccs811StandIn.h), so I2CBus and the
+ * drivers make the same Wire calls as on the device, and I2CBus logs
+ * the same I2CWRITE/I2CREAD trace (see I2CTrace.h).
+ *
+ * As in the ESP8266 core, endTransmission() and requestFrom() end up in
+ * twi_writeTo() and twi_readFrom() (twi.cpp), which hand the bytes to
+ * the stand-in attach()ed at that address. An address without one does
+ * not ACK (err 2). */
+
+#include <Arduino.h>
+#include <I2CStandIn.h>
+
+extern "C" {
+// 0 when ACKed, 2 for an address NACK, 3 for a data NACK.
+unsigned char twi_writeTo(
+    unsigned char address, unsigned char* buf, unsigned int len, unsigned char sendStop);
+unsigned char twi_readFrom(
+    unsigned char address, unsigned char* buf, unsigned int len, unsigned char sendStop);
+}
+void twi_attach(uint8_t addr, I2CStandIn* dev);  // NULL to take it off
+
+class TwoWire : public Stream {
+private:
+    static constexpr size_t BUFFER_LENGTH = 128;
+
+    uint8_t m_txaddr;
+    uint8_t m_tx[BUFFER_LENGTH];
+    size_t m_txlen;
+    uint8_t m_rx[BUFFER_LENGTH];
+    size_t m_rxlen;
+    size_t m_rxpos;
+
+public:
+    TwoWire() : m_txaddr(0), m_txlen(0), m_rxlen(0), m_rxpos(0) {}
+
+    void attach(uint8_t addr, I2CStandIn* dev) { twi_attach(addr, dev); }
+
+    void begin() {}
+    void begin(int sda, int scl) {}
+    void setClock(uint32_t freq) {}
+    void setClockStretchLimit(uint32_t limit) {}
+
+    void beginTransmission(uint8_t addr) { m_txaddr = addr; m_txlen = 0; }
+    void beginTransmission(int addr) { beginTransmission(static_cast<uint8_t>(addr)); }
+    uint8_t endTransmission(uint8_t sendStop = true);
+    uint8_t requestFrom(uint8_t addr, uint8_t len, uint8_t sendStop = true);
+    uint8_t requestFrom(int addr, int len, int sendStop = true) {
+        return requestFrom(static_cast<uint8_t>(addr), static_cast<uint8_t>(len),
+                           static_cast<uint8_t>(sendStop));
+    }
+
+    virtual size_t write(uint8_t ch);
+    virtual size_t write(const uint8_t* buf, size_t len);
+    using Print::write;
+    virtual int available() { return m_rxlen - m_rxpos; }
+    virtual int read() { return (m_rxpos < m_rxlen ? m_rx[m_rxpos++] : -1); }
+    virtual int peek() { return (m_rxpos < m_rxlen ? m_rx[m_rxpos] : -1); }
+    virtual void flush() {}
+};
+
+extern TwoWire Wire;
+
+#endif //INCLUDED_LOCAL_BOGODUINO_I2C_WIRE_H
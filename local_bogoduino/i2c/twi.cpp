@@ -0,0 +1,29 @@
+#include <Wire.h>
+
+// The devices on the bus, by 7-bit address.
+static I2CStandIn* twi_devices[128];
+
+void twi_attach(uint8_t addr, I2CStandIn* dev)
+{
+    twi_devices[addr & 0x7f] = dev;
+}
+
+unsigned char twi_writeTo(
+    unsigned char address, unsigned char* buf, unsigned int len, unsigned char sendStop)
+{
+    I2CStandIn* dev = twi_devices[address & 0x7f];
+    if (!dev) {
+        return 2;
+    }
+    return dev->on_write(buf, len) ? 0 : 3;
+}
+
+unsigned char twi_readFrom(
+    unsigned char address, unsigned char* buf, unsigned int len, unsigned char sendStop)
+{
+    I2CStandIn* dev = twi_devices[address & 0x7f];
+    if (!dev || !dev->on_read(buf, len)) {
+        return 2;
+    }
+    return 0;
+}
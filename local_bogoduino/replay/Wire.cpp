@@ -0,0 +1,188 @@
+#include <Wire.h>
+
+#include <stdio.h>
+#include <string.h>
+
+TwoWire Wire;
+
+TwoWire::TwoWire() :
+    m_pos(0), m_txaddr(0), m_rxpos(0),
+    m_transactions(0), m_bytes_written(0), m_bytes_read(0), m_mismatches(0)
+{
+    memset(m_traced, 0, sizeof(m_traced));
+    memset(m_stats, 0, sizeof(m_stats));
+}
+
+bool TwoWire::load(const char* filename)
+{
+    // Accept serial captures with timestamps and comments:
+    // 19:37:32.905514: I2CWRITE @ 0x5A :: 0x0,  <-- read status
+    FILE* fp = fopen(filename, "r");
+    if (!fp) {
+        return false;
+    }
+    char buf[512];
+    unsigned lineno = 0;
+    while (fgets(buf, sizeof(buf), fp)) {
+        const char* p;
+        Entry entry;
+        lineno += 1;
+        if ((p = strstr(buf, "I2CWRITE @ 0x"))) {
+            entry.is_read = false;
+        } else if ((p = strstr(buf, "I2CREAD  @ 0x"))) {
+            entry.is_read = true;
+        } else {
+            continue;
+        }
+        char* end;
+        entry.addr = strtoul(p + 13, &end, 16);
+        entry.err = 0;
+        entry.lineno = lineno;
+        if (!(p = strstr(end, "::"))) {
+            continue;
+        }
+        p += 2;
+        while (*p == ' ') {
+            ++p;
+        }
+        if (strncmp(p, "(err ", 5) == 0) {
+            entry.err = strtoul(p + 5, NULL, 10);
+        } else {
+            while (strncmp(p, "0x", 2) == 0) {
+                entry.data.push_back(strtoul(p + 2, &end, 16));
+                p = end;
+                while (*p == ',' || *p == ' ') {
+                    ++p;
+                }
+            }
+        }
+        m_traced[entry.addr & 0x7f] = true;
+        m_trace.push_back(entry);
+    }
+    fclose(fp);
+    return !m_trace.empty();
+}
+
+bool TwoWire::report(Print& out) const
+{
+    char buf[160];
+    snprintf(buf, sizeof(buf),
+             "replay: %lu transactions, %lu bytes written, %lu bytes read, "
+             "%lu mismatches, %zu trace lines left\r\n",
+             m_transactions, m_bytes_written, m_bytes_read,
+             m_mismatches, m_trace.size() - m_pos);
+    out.print(buf);
+    for (uint8_t addr = 0; addr < 128; ++addr) {
+        const Stats& stats = m_stats[addr];
+        if (stats.transactions) {
+            snprintf(buf, sizeof(buf),
+                     "replay: 0x%02X: %lu transactions, %lu bytes written, "
+                     "%lu bytes read%s\r\n",
+                     addr, stats.transactions, stats.bytes_written, stats.bytes_read,
+                     m_traced[addr] ? "" : " (not in trace)");
+            out.print(buf);
+        }
+    }
+    return m_mismatches == 0 && is_done();
+}
+
+void TwoWire::beginTransmission(uint8_t addr)
+{
+    m_txaddr = addr;
+    m_tx.clear();
+}
+
+uint8_t TwoWire::endTransmission(uint8_t sendStop)
+{
+    const Entry* expected = (is_done() ? NULL : &m_trace[m_pos]);
+    Stats& stats = m_stats[m_txaddr & 0x7f];
+    stats.transactions += 1;
+    stats.bytes_written += m_tx.size();
+    m_transactions += 1;
+    m_bytes_written += m_tx.size();
+    if (!m_traced[m_txaddr & 0x7f]) {
+        return 0;
+    }
+    if (!expected || expected->is_read || expected->addr != m_txaddr) {
+        if (m_tx.empty()) {
+            return 0;  // unrecorded address probe: ACK
+        }
+        mismatch("unexpected write", m_txaddr, expected);
+        return 4;
+    }
+    m_pos += 1;
+    if (!expected->err && expected->data != m_tx) {
+        mismatch("different write", m_txaddr, expected);
+    }
+    return expected->err;
+}
+
+uint8_t TwoWire::requestFrom(uint8_t addr, uint8_t len, uint8_t sendStop)
+{
+    const Entry* expected = (is_done() ? NULL : &m_trace[m_pos]);
+    m_rx.clear();
+    m_rxpos = 0;
+    Stats& stats = m_stats[addr & 0x7f];
+    stats.transactions += 1;
+    m_transactions += 1;
+    if (!m_traced[addr & 0x7f]) {
+        return 0;
+    }
+    if (!expected || !expected->is_read || expected->addr != addr) {
+        mismatch("unexpected read", addr, expected);
+        return 0;
+    }
+    m_pos += 1;
+    if (expected->err) {
+        return 0;
+    }
+    if (expected->data.size() != len) {
+        mismatch("different read length", addr, expected);
+    }
+    m_rx = expected->data;
+    m_rx.resize(len, 0xff);
+    stats.bytes_read += len;
+    m_bytes_read += len;
+    return len;
+}
+
+size_t TwoWire::write(uint8_t ch)
+{
+    m_tx.push_back(ch);
+    return 1;
+}
+
+size_t TwoWire::write(const uint8_t* buf, size_t len)
+{
+    m_tx.insert(m_tx.end(), buf, buf + len);
+    return len;
+}
+
+int TwoWire::available()
+{
+    return m_rx.size() - m_rxpos;
+}
+
+int TwoWire::read()
+{
+    return (m_rxpos < m_rx.size() ? m_rx[m_rxpos++] : -1);
+}
+
+int TwoWire::peek()
+{
+    return (m_rxpos < m_rx.size() ? m_rx[m_rxpos] : -1);
+}
+
+void TwoWire::mismatch(const char* what, uint8_t addr, const Entry* expected)
+{
+    m_mismatches += 1;
+    fprintf(stderr, "replay: %s @ 0x%X", what, addr);
+    if (expected) {
+        fprintf(stderr, " (trace line %u: %s @ 0x%X, %zu bytes)",
+                expected->lineno, expected->is_read ? "I2CREAD" : "I2CWRITE",
+                expected->addr, expected->data.size());
+    } else {
+        fprintf(stderr, " (trace exhausted)");
+    }
+    fprintf(stderr, "\n");
+}
@@ -0,0 +1,88 @@
+#ifndef INCLUDED_LOCAL_BOGODUINO_REPLAY_WIRE_H
+#define INCLUDED_LOCAL_BOGODUINO_REPLAY_WIRE_H
+
+/* Replacement for Wire.h that replays a recorded I2C trace (see
+ * I2CTrace.h) to whatever driver talks to it. Used by "make replay",
+ * which builds the real Adafruit_CCS811 and rgb_lcd drivers against it.
+ *
+ * Writes are compared to the next I2CWRITE line, reads are served from
+ * the next I2CREAD line. Differences are reported and counted, so a
+ * driver change shows up as a mismatch or as a different number of
+ * transactions/bytes (per address in the report). A device that is not
+ * in the trace at all (the LCD in local_bogoduino/replay/ccs811.trace)
+ * ACKs its writes and reads nothing. */
+
+#include <Arduino.h>
+#include <I2CStandIn.h>
+
+#include <vector>
+
+class TwoWire : public Stream {
+public:
+    struct Entry {
+        bool is_read;
+        uint8_t addr;
+        uint8_t err;
+        std::vector<uint8_t> data;
+        unsigned lineno;
+    };
+
+private:
+    std::vector<Entry> m_trace;
+    size_t m_pos;
+    uint8_t m_txaddr;
+    std::vector<uint8_t> m_tx;
+    std::vector<uint8_t> m_rx;
+    size_t m_rxpos;
+
+    struct Stats {
+        unsigned long transactions;
+        unsigned long bytes_written;
+        unsigned long bytes_read;
+    };
+    bool m_traced[128];             // by address: in the trace
+    Stats m_stats[128];             // by address
+    unsigned long m_transactions;
+    unsigned long m_bytes_written;
+    unsigned long m_bytes_read;
+    unsigned long m_mismatches;
+
+public:
+    TwoWire();
+
+    bool load(const char* filename);
+    bool is_done() const { return m_pos >= m_trace.size(); }
+    bool report(Print& out) const;  // true if everything matched
+
+    // The trace plays the devices; stand-ins are not asked.
+    void attach(uint8_t addr, I2CStandIn* dev) {}
+
+    void begin() {}
+    void begin(int sda, int scl) {}
+    void setClock(uint32_t freq) {}
+    void setClockStretchLimit(uint32_t limit) {}
+
+    void beginTransmission(uint8_t addr);
+    void beginTransmission(int addr) { beginTransmission(static_cast<uint8_t>(addr)); }
+    uint8_t endTransmission(uint8_t sendStop = true);
+    uint8_t requestFrom(uint8_t addr, uint8_t len, uint8_t sendStop = true);
+    uint8_t requestFrom(int addr, int len, int sendStop = true) {
+        return requestFrom(static_cast<uint8_t>(addr), static_cast<uint8_t>(len),
+                           static_cast<uint8_t>(sendStop));
+    }
+
+    virtual size_t write(uint8_t ch);
+    virtual size_t write(const uint8_t* buf, size_t len);
+    using Print::write;
+    virtual int available();
+    virtual int read();
+    virtual int peek();
+    virtual void flush() {}
+
+private:
+    void mismatch(const char* what, uint8_t addr, const Entry* expected);
+};
+
+extern TwoWire Wire;
+
+#endif //INCLUDED_LOCAL_BOGODUINO_REPLAY_WIRE_H
@@ -1,11 +1,79 @@
 #include <rgb_lcd.h>
 
+#include <Wire.h>
+
+// The same bus traffic as the Grove library (without its delays), so
+// the I2C byte counts are those of the real display.
+static constexpr uint8_t LCD_ADDRESS = 0x3E;
+static constexpr uint8_t RGB_ADDRESS = 0x62;
+
+static void i2c_send(uint8_t addr, const uint8_t* dta, uint8_t len)
+{
+    Wire.beginTransmission(addr);
+    Wire.write(dta, len);
+    Wire.endTransmission();
+}
+
+static void lcd_command(uint8_t value)
+{
+    uint8_t dta[2] = {0x80, value};
+    i2c_send(LCD_ADDRESS, dta, 2);
+}
+
+static void rgb_reg(uint8_t reg, uint8_t dat)
+{
+    uint8_t dta[2] = {reg, dat};
+    i2c_send(RGB_ADDRESS, dta, 2);
+}
+
 rgb_lcd::rgb_lcd() {}
 
-void rgb_lcd::begin(uint8_t cols, uint8_t rows, uint8_t charsize) {}
-void rgb_lcd::clear() {}
-void rgb_lcd::setCursor(uint8_t, uint8_t) {}
-void rgb_lcd::setRGB(unsigned char r, unsigned char g, unsigned char b) {}
+void rgb_lcd::begin(uint8_t cols, uint8_t rows, uint8_t charsize)
+{
+    uint8_t function = 0x20 | (rows > 1 ? 0x08 : 0) | charsize;
+    for (uint8_t i = 0; i < 4; ++i) {
+        lcd_command(function);  // FUNCTIONSET, as in the HD44780 init
+    }
+    lcd_command(0x0C);          // DISPLAYCONTROL: on
+    clear();
+    lcd_command(0x06);          // ENTRYMODESET: left to right
+    rgb_reg(0x00, 0x00);        // MODE1
+    rgb_reg(0x08, 0xff);        // OUTPUT
+    rgb_reg(0x01, 0x20);        // MODE2
+    setRGB(255, 255, 255);
+}
+
+void rgb_lcd::clear()
+{
+    lcd_command(0x01);
+}
+
+void rgb_lcd::setCursor(uint8_t col, uint8_t row)
+{
+    lcd_command(row == 0 ? (col | 0x80) : (col | 0xc0));
+}
+
+void rgb_lcd::setRGB(unsigned char r, unsigned char g, unsigned char b)
+{
+    rgb_reg(0x04, r);
+    rgb_reg(0x03, g);
+    rgb_reg(0x02, b);
+}
+
+void rgb_lcd::createChar(uint8_t location, uint8_t charmap[])
+{
+    location &= 0x7;
+    lcd_command(0x40 | (location << 3));  // SETCGRAMADDR
+    uint8_t dta[9];
+    dta[0] = 0x40;
+    memcpy(dta + 1, charmap, 8);
+    i2c_send(LCD_ADDRESS, dta, 9);
+}
 
 // Virtual
-size_t rgb_lcd::write(uint8_t) { return 1; }
+size_t rgb_lcd::write(uint8_t value)
+{
+    uint8_t dta[2] = {0x40, value};
+    i2c_send(LCD_ADDRESS, dta, 2);
+    return 1;
+}
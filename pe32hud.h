@@ -8,26 +8,103 @@
 #if defined(ARDUINO_ARCH_ESP32)
 #define HAVE_HTTPCLIENT
 #define HAVE_ESPWIFI
+#define HAVE_UPDATER
 #include <WiFi.h>
 #include <HTTPClient.h>
 #include <ArduinoMqttClient.h>
+#include <Update.h>
 #elif defined(ARDUINO_ARCH_ESP8266)
 #define HAVE_HTTPCLIENT
 #define HAVE_ESPWIFI
+#define HAVE_UPDATER
 #include <ESP8266WiFi.h>
 #include <ESP8266HTTPClient.h>
 #include <ArduinoMqttClient.h>
+#include <Updater.h>
 #elif defined(ARDUINO_ARCH_AVR)
 /* nothing yet */
 #elif defined(TEST_BUILD)
+#define HAVE_HTTPCLIENT
 #define HAVE_ESPWIFI
+#define HAVE_UPDATER
 #include <ESPWiFi.h>
+#include <HTTPClient.h>
 #include <ArduinoMqttClient.h>
+#include <Updater.h>
+#endif
+
+/* Run the NetworkComponent on its own core: a FreeRTOS task on the
+ * protocol core of a dual-core ESP32 (unless -DPE32HUD_SINGLECORE), or
+ * a std::thread in the TEST_BUILD with -DTEST_THREADS. See
+ * Concurrency.h. */
+#if (defined(ARDUINO_ARCH_ESP32) && !CONFIG_FREERTOS_UNICORE && \
+        !defined(PE32HUD_SINGLECORE)) || (defined(TEST_BUILD) && defined(TEST_THREADS))
+#define HAVE_DUALCORE
+#endif
+
+/* Flash-resident constants (pgmspace); plain memory in the TEST_BUILD.
+ * For "make footprint" (FOOTPRINT_BUILD) they get .irom sections named
+ * like on the ESP8266, so that the host objects do not count them as
+ * RAM either. A PSTR() section per use keeps the ones in inline
+ * functions from clashing. */
+#if defined(TEST_BUILD) && defined(FOOTPRINT_BUILD)
+#define PGM_STRINGIZE_2_(x) #x
+#define PGM_STRINGIZE_(x) PGM_STRINGIZE_2_(x)
+#undef PROGMEM
+#define PROGMEM __attribute__((section(".irom.text")))
+#undef PSTR
+#define PSTR(s) (__extension__({ \
+    static const char __pstr__[] __attribute__((section(".irom0.pstr." __FILE__ "." \
+        PGM_STRINGIZE_(__LINE__) "." PGM_STRINGIZE_(__COUNTER__)))) = (s); \
+    &__pstr__[0]; }))
+#undef F
+#define F(s) (reinterpret_cast<const __FlashStringHelper*>(PSTR(s)))
+#endif
+#ifndef PROGMEM
+#define PROGMEM
+#endif
+#ifndef PGM_P
+#define PGM_P const char*
+#endif
+#ifndef PSTR
+#define PSTR(s) (s)
+#endif
+#ifndef pgm_read_byte
+#define pgm_read_byte(addr) (*reinterpret_cast<const uint8_t*>(addr))
+#endif
+#ifndef strlen_P
+#define strlen_P strlen
+#endif
+#ifndef strncmp_P
+#define strncmp_P strncmp
+#endif
+#ifndef strcpy_P
+#define strcpy_P strcpy
+#endif
+#ifndef memcpy_P
+#define memcpy_P memcpy
+#endif
+#ifndef snprintf_P
+#define snprintf_P snprintf
+#endif
+
+/* Interrupt handlers live in IRAM on the ESP; elsewhere it's a no-op. */
+#ifndef IRAM_ATTR
+#define IRAM_ATTR
+#endif
+#ifndef NOT_AN_INTERRUPT
+#define NOT_AN_INTERRUPT (-1)
 #endif
 
 #include "arduino_secrets.h"
 
-#define DEBUG
+/* Firmware version, compared against the OTA manifest version. Set it
+ * when building an image for OTA: -DPE32HUD_VERSION='"2023.09.1"' */
+#ifndef PE32HUD_VERSION
+#define PE32HUD_VERSION "dev"
+#endif
+
+#include "Log.h"
 
 /* Neat trick to let us do multiple Serial.print() using the << operator:
  * Serial << x << " " << y << LF; */
@@ -36,16 +113,17 @@ template<class T> inline Print &operator<<(Print &obj, T arg) {
   return obj;
 };
 
-class BinToggle {
-public:
-  virtual void toggle(bool on) = 0;
+/* Output pins as types: the pin and its levels are template arguments,
+ * so toggle() is a digitalWrite() of constants, inlined where it is
+ * used. NoPin stands in for one that is not wired. */
+template<uint8_t PIN, uint8_t OFF, uint8_t ON> struct OutputPin {
+  static void setup() { pinMode(PIN, OUTPUT); digitalWrite(PIN, OFF); }
+  static void toggle(bool on) { digitalWrite(PIN, on ? ON : OFF); }
 };
 
-class NullToggleType : public BinToggle {
-public:
-  virtual void toggle(bool) {};
+struct NoPin {
+  static void setup() {}
+  static void toggle(bool) {}
 };
 
-extern NullToggleType NullToggle;
-
 #endif  //INCLUDED_PE32HUD_H
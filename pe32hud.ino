@@ -24,7 +24,11 @@
 #include "pe32hud.h"
 
 #include "Device.h"
+#include "FlightRecorder.h"
+#include "I2CBus.h"
+#include "Metrics.h"
 
+#include "ComponentList.h"
 #include "AirQualitySensorComponent.h"
 #include "DisplayComponent.h"
 #include "LedStatusComponent.h"
@@ -40,14 +44,18 @@
 static constexpr int PIN_SCL = 5;  // D1 / GPIO5
 static constexpr int PIN_SDA = 4;  // D2 / GPIO4
 
-// Air quality sensor on I2C, with a reset PIN (LOW to reset)
+// Air quality sensor on I2C, with a reset PIN (LOW to reset) and an
+// optional data ready PIN (nINT, -1 when not wired)
 static constexpr int CCS811_RST = 12;
+static constexpr int CCS811_NINT = -1;
 
 // LEDs are shared with GPIO pins 0 and 2
 static constexpr int LED_RED = 0;
 static constexpr int LED_BLUE = 2;
 
-// Temperature sensor using a single GPIO pin
+// Temperature sensor using a single GPIO pin. GPIO16 has no interrupt
+// on the ESP8266, so the Dht11Reader polls it (see Dht11Reader.h). Use
+// the pull-up on the DHT11 module.
 static constexpr int PIN_DHT11 = 16;
 
 // We use output HIGH for all these PINs so they're not detected as
@@ -70,24 +78,10 @@ int main(int argc, char** argv);
 // HARDWARE
 //
 
-class Gpio : public BinToggle {
-protected:
-  uint8_t const m_pin;
-  int8_t const m_off;
-  int8_t const m_on;
-public:
-  Gpio(uint8_t pin, int8_t off, int8_t on)
-    : m_pin(pin), m_off(off), m_on(on) {
-    pinMode(m_pin, OUTPUT);
-    digitalWrite(m_pin, m_off);
-  }
-  virtual void toggle(bool on) { digitalWrite(m_pin, on ? m_on : m_off); }
-};
-
-NullToggleType NullToggle;
-Gpio ccs811Reset(CCS811_RST, HIGH, LOW);
-Gpio ledRed(LED_RED, LED_OFF, LED_ON);
-Gpio ledBlue(LED_BLUE, LED_OFF, LED_ON);
+// The pins are template arguments: toggle() compiles to a single
+// digitalWrite(), without a vtable or a stored pin number.
+typedef OutputPin<LED_RED, LED_OFF, LED_ON> LedRed;
+typedef OutputPin<LED_BLUE, LED_OFF, LED_ON> LedBlue;
 
 
 ////////////////////////////////////////////////////////////////////////
@@ -95,16 +89,78 @@ Gpio ledBlue(LED_BLUE, LED_OFF, LED_ON);
 //
 
 Device Device;  // the one and only Device
+FlightRecorder FlightRecorder;  // survives resets, see FlightRecorder.h
+LogBuffer Log;  // buffered Serial output, see Log.h
+Metrics Metrics;  // scraped over HTTP, see Metrics.h
+
+I2CBus i2cBus(&Wire);  // shared by the CCS811 and the LCD
 
-AirQualitySensorComponent airQualitySensorComponent(&Wire, ccs811Reset);
-DisplayComponent displayComponent(&Wire);
-LedStatusComponent ledStatusComponent(
-  [](bool on){ ledRed.toggle(on); }, [](bool on){ ledBlue.toggle(on); });
+AirQualitySensorComponent airQualitySensorComponent(i2cBus, CCS811_RST, CCS811_NINT);
+DisplayComponent displayComponent(i2cBus);
+BoundLedStatusComponent<LedRed, LedBlue> ledStatusComponent;
 NetworkComponent networkComponent; // FIXME: pass SECRET_* here..?
 SunscreenComponent sunscreenComponent(SOMFY_SEL, SOMFY_DN, SOMFY_UP);
 TemperatureSensorComponent temperatureSensorComponent(PIN_DHT11);
 
 
+////////////////////////////////////////////////////////////////////////
+// NETWORK CORE (HAVE_DUALCORE, see Concurrency.h)
+//
+
+#ifdef HAVE_DUALCORE
+#ifdef TEST_THREADS
+std::atomic<bool> networkRunning(false);
+std::thread networkThread;
+#endif
+
+void network_task(void*) {
+  Device.set_network_task(current_task());
+  for (;;) {
+    networkComponent.loop();
+#ifdef TEST_THREADS
+    if (!networkRunning) {
+      return;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+#else
+    delay(1);  // let the other tasks on this core run
+#endif
+  }
+}
+
+void start_network_task() {
+#ifdef TEST_THREADS
+  networkRunning = true;
+  networkThread = std::thread(network_task, nullptr);
+#else
+  // Core 0 (PRO_CPU) also runs the WiFi and lwIP tasks; the Arduino
+  // loop() runs on core 1 (APP_CPU).
+  xTaskCreatePinnedToCore(network_task, "network", 8192, NULL, 1, NULL, 0);
+#endif
+}
+
+// In the component list, the network is set up from here, but its
+// loop() runs on the network core; this core only applies its results.
+struct NetworkCoreProxy {
+  void setup() { networkComponent.setup(); }
+  void loop() { Device.apply_queued(); }
+} networkCoreProxy;
+#endif
+
+// All components, in setup() and loop() order.
+static constexpr auto components = make_components(
+  airQualitySensorComponent,
+  displayComponent,
+  ledStatusComponent,
+#ifdef HAVE_DUALCORE
+  networkCoreProxy,
+#else
+  networkComponent,
+#endif
+  sunscreenComponent,
+  temperatureSensorComponent);
+
+
 ////////////////////////////////////////////////////////////////////////
 // main program
 //
@@ -119,36 +175,335 @@ void setup() {
   Serial.begin(115200);
   while (!Serial) {}
   delay(500);
-  Serial << F("Booting...\r\n");
+  LOG_INFO(MAIN) << F("Booting...\r\n");
+  FlightRecorder.setup();
+  Log.flush();
 
-#if defined(ARDUINO_ARCH_ESP32) || defined(ARDUINO_ARCH_ESP8266)
-  Wire.begin(PIN_SDA, PIN_SCL);  // non-standard ESP invocation
-#else
-  Wire.begin();  // fixed I2C pins on the Arduino
-#endif
+  i2cBus.begin(PIN_SDA, PIN_SCL);  // SDA/SCL are ignored on the Arduino
 
-  airQualitySensorComponent.setup();
-  displayComponent.setup();
-  ledStatusComponent.setup();
-  networkComponent.setup();
-  sunscreenComponent.setup();
-  temperatureSensorComponent.setup();
+  // Each setup can log more than the buffer holds, and nothing drains
+  // it until loop().
+  components.setup([]() { Log.flush(); });
+#ifdef HAVE_DUALCORE
+  start_network_task();
+#endif
 }
 
 
 void loop() {
-  airQualitySensorComponent.loop();
-  displayComponent.loop();
-  ledStatusComponent.loop();
-  networkComponent.loop();
-  sunscreenComponent.loop();
-  temperatureSensorComponent.loop();
+  unsigned long start = millis();
+
+  Device.loop();  // sampling epochs, see Device::telemetry()
+  components.loop();
+  i2cBus.loop();  // run one queued I2C job
+
+  unsigned long elapsed = millis() - start;
+  Metrics.add_loop(elapsed);
+  if (elapsed >= FlightRecorder::STALL_MS) {
+    FlightRecorder.record(
+      FlightRecorder::EV_LOOP_STALL, 0, elapsed < 0xffff ? elapsed : 0xffff);
+  }
+
+  // Idle time: write out buffered log lines without blocking.
+  Log.drain();
 }
 
 
-#if TEST_BUILD
+#if TEST_BUILD && !defined(FOOTPRINT_BUILD)
 #include "xtoa.h"
+#include <math.h>  // isnan
+#include <Ccs811StandIn.h>
+#include <Dht11StandIn.h>
+#include <HttpStandIn.h>
+#include <HudServerStandIn.h>
+
+#ifdef TEST_BENCH
+#include <chrono>
+#include <new>
+#include <unistd.h>
+
+// Allocation counters. The bench build links with -Wl,--wrap=malloc
+// (and calloc/realloc), so String and operator new both count here.
+static unsigned long benchAllocs, benchAllocBytes;
+
+extern "C" {
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t n, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+
+void* __wrap_malloc(size_t size) {
+  benchAllocs += 1;
+  benchAllocBytes += size;
+  return __real_malloc(size);
+}
+void* __wrap_calloc(size_t n, size_t size) {
+  benchAllocs += 1;
+  benchAllocBytes += n * size;
+  return __real_calloc(n, size);
+}
+void* __wrap_realloc(void* ptr, size_t size) {
+  benchAllocs += 1;
+  benchAllocBytes += size;
+  return __real_realloc(ptr, size);
+}
+}
+
+void* operator new(size_t size) {
+  void* ptr = malloc(size);
+  if (!ptr) {
+    throw std::bad_alloc();
+  }
+  return ptr;
+}
+void* operator new[](size_t size) { return operator new(size); }
+void operator delete(void* ptr) noexcept { free(ptr); }
+void operator delete[](void* ptr) noexcept { free(ptr); }
+void operator delete(void* ptr, size_t) noexcept { free(ptr); }
+void operator delete[](void* ptr, size_t) noexcept { free(ptr); }
+
+/* Run op() N times, doubling N until that takes at least bench_ms, and
+ * print one line in the Go benchmark format, which benchstat reads:
+ *
+ *   BenchmarkParseRemote/snapshot  262144  1874 ns/op  352 B/op  9 allocs/op
+ *
+ * With i2c set, also report the I2C bytes that device wrote per op. */
+static unsigned long bench_ms = 200;
+static FILE* bench_out;
+
+template<class Op> static void bench(const char* name, Op op, const I2CDevice* i2c = NULL) {
+  for (unsigned long n = 1; ; n *= 2) {
+    uint32_t i2c_before = (i2c ? i2c->bytes_written : 0);
+    unsigned long allocs = benchAllocs, bytes = benchAllocBytes;
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned long i = 0; i < n; ++i) {
+      op();
+    }
+    double ns = std::chrono::duration<double, std::nano>(
+      std::chrono::steady_clock::now() - start).count();
+    if (ns < bench_ms * 1e6 && n < (1UL << 30)) {
+      continue;
+    }
+    fprintf(bench_out, "Benchmark%s\t%lu\t%.1f ns/op\t%lu B/op\t%lu allocs/op",
+            name, n, ns / n, (benchAllocBytes - bytes) / n, (benchAllocs - allocs) / n);
+    if (i2c) {
+      fprintf(bench_out, "\t%lu i2c-B/op", (unsigned long)(i2c->bytes_written - i2c_before) / n);
+    }
+    fprintf(bench_out, "\n");
+    fflush(bench_out);
+    return;
+  }
+}
+#endif
+
 int main(int argc, char** argv) {
+  // The DHT11 answers with 42% RH and 17.5 'C (see Dht11StandIn.h).
+  static Dht11StandIn dht11(42, 17.5);
+  dht11.attach(temperatureSensorComponent.m_dht11);
+  // And the CCS811 with 407 ppm eCO2, unless we replay a real trace.
+  // The LCD and its backlight only ACK.
+  static Ccs811StandIn ccs811(407, 1, 0x3412);
+  static I2CStandIn lcd, backlight;
+#ifndef I2C_REPLAY
+  ccs811.attach(Wire);
+  Wire.attach(0x3E, &lcd);
+  Wire.attach(0x62, &backlight);
+#endif
+
+  // Dump tool: ./pe32hud.test flightrec 'boot=3&events=...'
+  if (argc == 3 && strcmp(argv[1], "flightrec") == 0) {
+    if (!FlightRecorder.load_formdata(argv[2])) {
+      fprintf(stderr, "flightrec: expected boot=N&events=HEX\n");
+      return 1;
+    }
+    FlightRecorder.dump(Serial);
+    return 0;
+  }
+#ifdef TEST_BENCH
+  // Benchmarks: ./pe32hud.bench-Os bench [ms] (see "make bench")
+  if (argc >= 2 && strcmp(argv[1], "bench") == 0) {
+    if (argc == 3) {
+      bench_ms = strtoul(argv[2], NULL, 10);
+    }
+    // Results on stdout; the firmware (Serial, Log) writes to /dev/null.
+    bench_out = fdopen(dup(1), "w");
+    if (!bench_out || !freopen("/dev/null", "w", stdout)) {
+      perror("bench");
+      return 1;
+    }
+    fprintf(bench_out, "pkg: pe32hud\nopt: %s\ncommit: %s\n", BENCH_OPT, BENCH_COMMIT);
+
+    // HUD documents: a full snapshot as the server sends it, a one
+    // field delta, and a worst case of long lines and unknown keys.
+    HudServerStandIn hud;
+    hud.set(HudServerStandIn::COLOR, "#00ff68");
+    hud.set(HudServerStandIn::LINE0, " -814 W    39 ms");
+    hud.set(HudServerStandIn::LINE1, "^11.981  v 5.637");
+    hud.set(HudServerStandIn::ACTION, "UP");
+    const String snapshot = hud.reply(0);
+    NetworkComponent::RemoteResult base;
+    NetworkComponent::parse_remote(snapshot, base);
+    hud.set(HudServerStandIn::LINE0, " -790 W    41 ms");
+    const String delta = hud.reply(base.version);
+    String longline, worst;
+    for (int i = 0; i < 8; ++i) {
+      longline += F("0123456789abcdef");
+    }
+    for (int i = 0; i < 32; ++i) {
+      worst += F("x-unknown-key-");
+      worst += String(i);
+      worst += F(":0123456789abcdef0123456789abcdef\r\n");
+    }
+    worst += F("color:#ff0000\r\nline0:");
+    worst += longline;
+    worst += F("\r\nline1:");
+    worst += longline;
+    worst += F("\r\naction:DOWN");
+
+    bench("ParseRemote/snapshot", [&]() {
+      NetworkComponent::RemoteResult res;
+      NetworkComponent::parse_remote(snapshot, res);
+    });
+    bench("ParseRemote/delta", [&]() {
+      NetworkComponent::RemoteResult res = base;
+      NetworkComponent::parse_remote(delta, res);
+    });
+    bench("ParseRemote/worst", [&]() {
+      NetworkComponent::RemoteResult res;
+      NetworkComponent::parse_remote(worst, res);
+    });
+
+    // The components, against the stand-ins; bring everything up first.
+    setup();
+    for (int i = 0; i < 50; ++i) {
+      millis(millis() + 105);
+      loop();
+    }
+    bench("Sample/airquality", []() { airQualitySensorComponent.sample(); });
+    bench("Sample/temperature", []() { temperatureSensorComponent.sample(); });
+    // The show_job()s, holding the bus as I2CBus::loop() does.
+    I2CDevice& lcd = displayComponent.m_i2cdev;
+    bench("Show/full", [&lcd]() {
+      displayComponent.m_dirty = (DisplayComponent::DIRTY_COLOR |
+        DisplayComponent::DIRTY_LINE0 | DisplayComponent::DIRTY_LINE1);
+      i2cBus.acquire(lcd);
+      while (displayComponent.m_dirty) {
+        displayComponent.show();
+      }
+      i2cBus.release();
+    }, &lcd);
+    bench("Show/line", [&lcd]() {
+      displayComponent.m_dirty = DisplayComponent::DIRTY_LINE0;
+      i2cBus.acquire(lcd);
+      displayComponent.show();
+      i2cBus.release();
+    }, &lcd);
+    // A new sample on a sparkline line: the shifted cells and the line.
+    Device.set_text("CO2 {eco2:~}{eco2:^}", "", Device::COLOR_GREEN);
+    bench("Show/sparkline", [&lcd]() {
+      static unsigned n;
+      Device.set_reading(Device::READING_ECO2, 400 + (n++ % 7) * 50);
+      i2cBus.acquire(lcd);
+      while (displayComponent.m_dirty) {
+        displayComponent.show();
+      }
+      i2cBus.release();
+    }, &lcd);
+    bench("Blink", []() {
+      millis(millis() + 50);
+      ledStatusComponent.loop();
+    });
+    bench("Alert", []() {
+      Device.set_alert(Device::INACTIVE_DHT11);
+      Device.clear_alert(Device::INACTIVE_DHT11);
+    });
+    bench("Metrics/render", []() {
+      static char buf[NetworkComponent::METRICS_BUFFER_SIZE];
+      Metrics.render(buf, sizeof(buf));
+    });
+    bench("Loop", []() {
+      millis(millis() + 105);
+      loop();
+    });
+    return 0;
+  }
+#endif
+#ifdef TEST_THREADS
+  // Stress test for the dual-core mode: ./pe32hud.stress stress
+  if (argc == 2 && strcmp(argv[1], "stress") == 0) {
+    // The queue on its own: Strings both ways at once, none lost or
+    // reordered.
+    static SpscQueue<String, 8> up, down;
+    const unsigned long count = 200000;
+    auto pump = [count](SpscQueue<String, 8>& out, SpscQueue<String, 8>& in) {
+      unsigned long sent = 0, received = 0, bad = 0;
+      String item;
+      while (sent < count || received < count) {
+        bool busy = false;
+        if (sent < count && out.push(String(sent))) {
+          ++sent;
+          busy = true;
+        }
+        if (in.pop(item)) {
+          bad += (item != String(received));
+          ++received;
+          busy = true;
+        }
+        if (!busy) {
+          std::this_thread::yield();  // the other side may share our core
+        }
+      }
+      return bad;
+    };
+    unsigned long bad_other = 0;
+    std::thread other([&]() { bad_other = pump(down, up); });
+    unsigned long bad = pump(up, down);
+    other.join();
+    bad += bad_other;
+    printf("[spsc: %lu each way, out of order == 0 == %lu]\n", count, bad);
+
+    // The firmware: loop() here, networkComponent.loop() on the network
+    // thread. Only this thread advances the (mock) clock.
+    static HudServerStandIn hud;
+    hud.set(HudServerStandIn::LINE0, "dualcore");
+    hud.serve(SECRET_HUD_URL);
+    setup();
+    for (unsigned long i = 0, ms = millis(); i < 3000; ++i, ms += 105) {
+      millis(ms);
+      loop();
+      std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+    networkRunning = false;
+    networkThread.join();
+    Device.apply_queued();
+    Log.drain();
+    MqttClient& broker = networkComponent.m_mqttclient;
+    printf("[dualcore: dropped == 0 == %lu, %u published, HUD == %s]\n",
+           Device.get_dropped(), broker.delivered + broker.on_wire,
+           displayComponent.m_message0.c_str());
+    return (bad || Device.get_dropped()) ? 1 : 0;
+  }
+  // The tests below poke at the components from this thread.
+  fprintf(stderr, "usage: %s stress\n", argv[0]);
+  return 1;
+#endif
+#ifdef I2C_REPLAY
+  // Replay tool: ./pe32hud.replay replay trace.txt (see I2CTrace.h)
+  if (argc == 3 && strcmp(argv[1], "replay") == 0) {
+    if (!Wire.load(argv[2])) {
+      fprintf(stderr, "replay: no I2C trace lines in %s\n", argv[2]);
+      return 1;
+    }
+    setup();
+    for (unsigned long ms = millis(), i = 0; !Wire.is_done() && i < 100000; ++i, ms += 105) {
+      millis(ms);  // HACKS: set the milliseconds
+      loop();
+    }
+    Log.drain();
+    i2cBus.dump_stats(Serial);
+    return Wire.report(Serial) ? 0 : 1;
+  }
+#endif
+
   char buf[30];
   dtostrf(1234.5678, 15, 2, buf);
   printf("[%s]\n", buf);
@@ -173,6 +528,57 @@ int main(int argc, char** argv) {
   printf("[line0 == %s]\n", res.message0.c_str());
   printf("[line1 == %s]\n", res.message1.c_str());
 
+  // Versioned HUD: a snapshot first, then deltas with only the changed
+  // field, then a snapshot again once we are too far behind.
+  HudServerStandIn hud;
+  hud.set(HudServerStandIn::COLOR, "#00ff68");
+  hud.set(HudServerStandIn::LINE0, " -814 W    39 ms");
+  hud.set(HudServerStandIn::LINE1, "^11.981  v 5.637");
+  hud.set(HudServerStandIn::ACTION, "UP");
+  NetworkComponent::RemoteResult hudres;
+  String reply = hud.reply(hudres.version);
+  uint8_t changed = NetworkComponent::parse_remote(reply, hudres);
+  printf("[hud snapshot v4 == %lu, changed == f == %x, %u bytes]\n",
+         (unsigned long)hudres.version, changed, reply.length());
+  hud.set(HudServerStandIn::LINE0, " -790 W    41 ms");
+  reply = hud.reply(hudres.version);
+  changed = NetworkComponent::parse_remote(reply, hudres);
+  printf("[hud delta v5 == %lu, changed == 2 == %x, %u bytes, line0 == %s]\n",
+         (unsigned long)hudres.version, changed, reply.length(), hudres.message0.c_str());
+  printf("[hud delta kept line1 == %s, action == 4 == %d]\n",
+         hudres.message1.c_str(), hudres.sunscreen);
+  for (int n = 0; n < 5; ++n) {
+    hud.set(HudServerStandIn::LINE1, String("^11.98") + n);
+  }
+  reply = hud.reply(hudres.version);
+  changed = NetworkComponent::parse_remote(reply, hudres);
+  printf("[hud behind: snapshot v10 == %lu, changed == 4 == %x, %u bytes]\n",
+         (unsigned long)hudres.version, changed, reply.length());
+  changed = NetworkComponent::parse_remote("version:12\nbase:11\nline0:x", hudres);
+  printf("[hud bad base == 80 == %x, v10 == %lu]\n", changed, (unsigned long)hudres.version);
+
+  // OTA: feed an image through the download/verify pipeline from a
+  // stand-in HTTP server, then a corrupted one.
+  static uint8_t image[10000];
+  for (size_t i = 0; i < sizeof(image); ++i) {
+    image[i] = i * 7;
+  }
+  NetworkComponent::UpdateManifest manifest;
+  bool manifest_ok = NetworkComponent::parse_manifest(
+    "version:2023.09.1\n"
+    "url:http://localhost:8080/pe32hud.ino.bin.gz\n"
+    "size:10000\n"
+    "md5:06a474d076d55fe5bdaafbb83017ffca", manifest);
+  printf("[manifest == 1 == %d]\n", manifest_ok);
+  HttpStandIn server(image, sizeof(image));
+  bool update_ok = NetworkComponent::write_update(server, manifest);
+  printf("[update == 1 == %d (%zu bytes, %zu sectors)]\n",
+         update_ok, Update.written, Update.sectors_written());
+  image[5000] ^= 0x01;
+  HttpStandIn corrupt(image, sizeof(image), 100);
+  update_ok = NetworkComponent::write_update(corrupt, manifest);
+  printf("[corrupt update == 0 == %d, md5 error == 7 == %u]\n", update_ok, Update.getError());
+
   Serial.println("millis (3x):");
   Serial.println(millis());
   Serial.println(millis());
@@ -180,8 +586,10 @@ int main(int argc, char** argv) {
 
   // Test setup and loop once
   printf("<<< setup >>>\n");
+  unsigned long dropped = Log.get_dropped();
   setup();
   printf("\n");
+  printf("[log boot dropped == 0 == %lu]\n", Log.get_dropped() - dropped);
   int i;
   unsigned long ms, lastms = millis();
   for (i = 0, ms = millis(); i < 50; ++i, ms += 105) {
@@ -192,6 +600,422 @@ int main(int argc, char** argv) {
     lastms = millis();
   }
 
+  // MQTT: run the connect state machine in 100 ms passes until it is
+  // (back) up, against the broker stand-in; returns the longest pass.
+  MqttClient& broker = networkComponent.m_mqttclient;
+  auto mqtt_until_up = [](unsigned long limit) {
+    unsigned long longest = 0;
+    unsigned long start = millis();
+    do {
+      unsigned long before = millis();
+      networkComponent.step_mqtt();
+      if ((millis() - before) > longest) {
+        longest = millis() - before;
+      }
+      millis(millis() + 100);
+    } while ((millis() - start) < limit &&
+             networkComponent.m_mqttstate != NetworkComponent::MQTT_UP);
+    return longest;
+  };
+  millis(millis() + NetworkComponent::MQTT_ACK_MS);
+  networkComponent.ensure_mqtt();   // retire what the loop sent
+
+  // Flap the link with three QoS 1 messages on the wire and refuse the
+  // first reconnect; all three should still arrive.
+  unsigned lookups = WiFi.lookups, delivered = broker.delivered;
+  unsigned resent = broker.resent, resumed = broker.resumed;
+  networkComponent.push_remote(F("pe32/hud/test"), "n=1");
+  networkComponent.push_remote(F("pe32/hud/test"), "n=2");
+  networkComponent.push_remote(F("pe32/hud/test"), "n=3");
+  broker.refuse = 1;
+  broker.set_link(false);
+  broker.set_link(true);
+  mqtt_until_up(60000);             // resolves again, resumes, resends
+  millis(millis() + NetworkComponent::MQTT_ACK_MS);
+  networkComponent.ensure_mqtt();   // delivers, retires
+  Log.drain();
+  printf("[mqtt delivered == 3 == %u (%u resent, %u left)]\n",
+         broker.delivered - delivered, broker.resent - resent, networkComponent.m_noutbox);
+  printf("[mqtt resumed == 1 == %u (%u lookups)]\n",
+         broker.resumed - resumed, WiFi.lookups - lookups);
+
+  // Broker refusing for a while: the waits double (~1+2+4+8+16 s).
+  unsigned long attempts = networkComponent.get_mqtt_stats().attempts;
+  broker.refuse = 4;
+  broker.set_link(false);
+  broker.set_link(true);
+  mqtt_until_up(120000);
+  Log.drain();
+  printf("[mqtt refused: attempts == 5 == %lu (%lu ms to connect)]\n",
+         networkComponent.get_mqtt_stats().attempts - attempts,
+         networkComponent.get_mqtt_stats().time_to_connect);
+
+  // Slow broker: no pass blocks longer than the deadline.
+  broker.connect_ms = 10000;
+  broker.set_link(false);
+  broker.set_link(true);
+  unsigned long longest = mqtt_until_up(20000);
+  broker.connect_ms = 500;
+  unsigned long longest2 = mqtt_until_up(60000);
+  Log.drain();
+  printf("[mqtt slow: longest pass <= 3000 == %lu (up == 1 == %d)]\n",
+         longest > longest2 ? longest : longest2,
+         networkComponent.m_mqttstate == NetworkComponent::MQTT_UP);
+
+  // Roaming: stuck on a far AP of our SSID, with a near one of ours and
+  // an even nearer foreign one around.
+  auto run_network = [](unsigned long duration) {
+    for (unsigned long start = millis(); (millis() - start) < duration; ) {
+      networkComponent.loop();
+      Log.drain();
+      millis(millis() + 500);
+    }
+  };
+  WiFi.aps[0] = {SECRET_WIFI_SSID, {0x02, 0, 0, 0, 0, 0x01}, -82, 1};
+  WiFi.aps[1] = {"neighbours", {0x02, 0, 0, 0, 0, 0x02}, -40, 6};
+  WiFi.aps[2] = {SECRET_WIFI_SSID, {0x02, 0, 0, 0, 0, 0x03}, -58, 11};
+  WiFi.naps = 3;
+  // The move takes 8 s; that is no WiFi error, and no plain reconnect.
+  WiFi.movedown = 16;
+  unsigned plainbegins = WiFi.plainbegins;
+  bool wifierror = false;
+  Device.set_text("HUD", "", Device::COLOR_GREEN);
+  for (unsigned long start = millis(); (millis() - start) < 60000; millis(millis() + 500)) {
+    networkComponent.loop();
+    Log.drain();
+    wifierror |= displayComponent.m_message0.startsWith("Wifi");
+  }
+  printf("[roam to == 2 == %u (%u scans), plain begins == 0 == %u, wifi error == 0 == %d]\n",
+         WiFi.current, WiFi.scans, WiFi.plainbegins - plainbegins, wifierror);
+  WiFi.movedown = 0;
+  // Degraded again, but the other AP is only 5 dB better: one scan per
+  // holdoff and no roam.
+  WiFi.aps[2].rssi = -76;
+  WiFi.aps[0].rssi = -71;
+  run_network(NetworkComponent::ROAM_HOLDOFF + 60000);
+  printf("[roam stays == 2 == %u (%u scans)]\n", WiFi.current, WiFi.scans);
+
+  // Templated HUD: compiled once, re-rendered when a reading it uses
+  // changes, and left alone when another one does.
+  Device.set_text("CO2 {eco2} {x}", "{temp:.1}C {rssi}dBm", Device::COLOR_GREEN);
+  printf("[hud tpl == CO2 407 {x} | 17.5C -76dBm == %s | %s]\n",
+         displayComponent.m_message0.c_str(), displayComponent.m_message1.c_str());
+  displayComponent.m_dirty = 0;
+  Device.set_reading(Device::READING_ECO2, 612);
+  printf("[hud tpl eco2 == CO2 612 {x} == %s, dirty == 2 == %d]\n",
+         displayComponent.m_message0.c_str(), displayComponent.m_dirty);
+  displayComponent.m_dirty = 0;
+  Device.set_reading(Device::READING_TEMP, 21.44);
+  Device.set_reading(Device::READING_HUMIDITY, 40);
+  printf("[hud tpl temp == 21.4C -76dBm == %s, dirty == 4 == %d]\n",
+         displayComponent.m_message1.c_str(), displayComponent.m_dirty);
+
+  // Glyphs: the same bitmap twice takes one CGRAM slot; a redraw of
+  // the same content writes nothing, a new sample only what changed.
+  for (int n = 0; n < Device::HISTORY_SIZE; ++n) {
+    Device.set_reading(Device::READING_ECO2, 500);
+  }
+  Device.set_text("{eco2:~}{eco2:^} {eco2}", "{temp:^}C", Device::COLOR_GREEN);
+  auto show_all = []() {
+    // As the show_job would, holding the bus so its bytes count.
+    i2cBus.acquire(displayComponent.m_i2cdev);
+    while (displayComponent.m_dirty) {
+      displayComponent.show();
+    }
+    i2cBus.release();
+  };
+  show_all();
+  const String& glyphline = displayComponent.m_message0;
+  printf("[glyphs flat: cells == %d == %d, arrow == %d, text == 500 == %s]\n",
+         glyphline[0], glyphline[1], glyphline[2], glyphline.c_str() + 4);
+  GlyphCache& glyphs = displayComponent.m_glyphs;
+  uint32_t writes = glyphs.get_writes();
+  uint32_t lcdbytes = displayComponent.m_i2cdev.bytes_written;
+  Device.set_text("{eco2:~}{eco2:^} {eco2}", "{temp:^}C", Device::COLOR_GREEN);
+  show_all();
+  printf("[glyphs same: writes == 0 == %u, i2c == 0 == %u]\n",
+         glyphs.get_writes() - writes, displayComponent.m_i2cdev.bytes_written - lcdbytes);
+  writes = glyphs.get_writes();
+  lcdbytes = displayComponent.m_i2cdev.bytes_written;
+  // The left cell stays flat and line1 shows an up arrow for the
+  // temperature already, so only the right cell is written: a CGRAM
+  // address command and 8 rows of data (2 + 9 bytes), and line0
+  // (cursor command, 16 data writes: 2 + 16 * 2).
+  Device.set_reading(Device::READING_ECO2, 900);
+  show_all();
+  printf("[glyphs sample: writes == 1 == %u, arrow == line1 == %d == %d, i2c == 45 == %u]\n",
+         glyphs.get_writes() - writes, glyphline[2], displayComponent.m_message1[0],
+         displayComponent.m_i2cdev.bytes_written - lcdbytes);
+
+  // The cache on its own: the least recently used slot goes, but never
+  // one on screen elsewhere or in the same line.
+  GlyphCache cache;
+  uint8_t bitmap[GlyphCache::ROWS] = {0};
+  cache.begin(0);
+  for (uint8_t n = 0; n < GlyphCache::NUM_SLOTS; ++n) {
+    bitmap[0] = n;
+    cache.get(bitmap, '#');
+  }
+  bitmap[0] = 8;
+  char full = cache.get(bitmap, '#');
+  cache.begin(0);
+  for (uint8_t n = 1; n < GlyphCache::NUM_SLOTS; ++n) {
+    bitmap[0] = n;
+    cache.get(bitmap, '#');
+  }
+  bitmap[0] = 8;
+  char evicted = cache.get(bitmap, '#');
+  cache.begin(0xff);
+  bitmap[0] = 9;
+  char kept = cache.get(bitmap, '#');
+  printf("[glyph cache: full == # == %c, LRU == 8 == %d, kept == # == %c, hits == 7 == %u]\n",
+         full, evicted, kept, cache.get_hits());
+
+  // Sampling epochs: both sensors on the same tick, one message per
+  // epoch with a sequence number.
+  auto run_epoch = []() {
+    for (uint32_t epoch = Device.get_epoch(); Device.get_epoch() == epoch; ) {
+      millis(millis() + 105);
+      loop();
+    }
+  };
+  run_epoch();  // to the first tick
+  unsigned sent = broker.delivered + broker.on_wire;
+  run_epoch();
+  run_epoch();
+  Log.drain();
+  printf("[telemetry: 2 epochs, messages == 2 == %u]\n",
+         broker.delivered + broker.on_wire - sent);
+  String expected = String(
+    "device_id=EUI48:11:22:33:44:55:66&boot=1&seq=") + (Device.get_epoch() - 1) +
+    "&eco2=407&tvoc=1&baseline=13330&status=OK&temperature=17.50&humidity=42.00";
+  printf("[telemetry == %s == %s]\n", expected.c_str(), broker.message.c_str());
+  // A failed DHT11 read sends its status, and no NaN readings.
+  dht11.failure = Dht11StandIn::MUTE;
+  dht11.failures = Dht11Reader::MAX_TRIES;
+  for (int n = 0; n < 5 && broker.message.indexOf("status=TIMEOUT") < 0; ++n) {
+    run_epoch();
+  }
+  Log.drain();
+  printf("[telemetry dht11 failed: TIMEOUT == 1 == %d, nan == 0 == %d]\n",
+         broker.message.indexOf("&status=TIMEOUT") >= 0, broker.message.indexOf("nan") >= 0);
+  run_epoch();  // and a good one again
+
+  // Metrics endpoint: a scrape gets the counters as they are, with the
+  // right length; other paths get a 404, and a short buffer no body.
+  WiFiClient::Peer scrape, notfound;
+  scrape.request = "GET /metrics HTTP/1.1\r\nHost: pe32hud\r\nAccept: */*\r\n\r\n";
+  notfound.request = "GET / HTTP/1.1\r\n\r\n";
+  networkComponent.m_metricsserver.pending = &scrape;
+  networkComponent.loop();
+  networkComponent.m_metricsserver.pending = &notfound;
+  networkComponent.loop();
+  Log.drain();
+  const char* body = strstr(scrape.response.c_str(), "\r\n\r\n");
+  const char* loops = strstr(scrape.response.c_str(), "\npe32hud_loops_total ");
+  printf("[metrics == HTTP/1.0 200 OK == %.15s, closed == 0 == %d]\n",
+         scrape.response.c_str(), scrape.open);
+  printf("[metrics length == %lu == %zu]\n",
+         strtoul(strstr(scrape.response.c_str(), "Content-Length: ") + 16, NULL, 10),
+         body ? strlen(body + 4) : 0);
+  printf("[metrics loops == %lu == %lu, mqtt connects == %lu]\n",
+         (unsigned long)Metrics.get(Metrics::LOOPS),
+         loops ? strtoul(loops + 21, NULL, 10) : 0, (unsigned long)Metrics.get(Metrics::MQTT_CONNECTS));
+  printf("[metrics other path == HTTP/1.0 404 == %.12s]\n", notfound.response.c_str());
+  char shortbuf[64];
+  printf("[metrics short buffer == 0 == %zu]\n", Metrics.render(shortbuf, sizeof(shortbuf)));
+
+  // Metrics totals: on through a millis() wrap, past 2^32 ms.
+  {
+    class Metrics wrapped;
+    unsigned long saved = millis();
+    millis(4000000000UL);
+    wrapped.add_loop(0);
+    millis(4000000000UL + 400000000UL);  // wraps
+    wrapped.add_loop(0);
+    wrapped.add_fetch(200, 4000000000UL);
+    wrapped.add_fetch(200, 400000999UL);
+    static char buf[2048];
+    wrapped.render(buf, sizeof(buf));
+    millis(saved);
+    printf("[metrics uptime == 4400000 == %lu, fetch == 4400000.999 == %.11s]\n",
+           (unsigned long)wrapped.get_seconds(Metrics::UPTIME),
+           strstr(buf, "pe32hud_fetch_seconds_sum ") + 26);
+  }
+
+  // CCS811: one burst read per sample, the baseline every 20th; nothing
+  // published without DATA_READY, and FAILING on the ERROR flag.
+  unsigned result_reads = ccs811.result_reads, baseline_reads = ccs811.baseline_reads;
+  for (int n = 0; n < 40; ++n) {
+    airQualitySensorComponent.sample();
+  }
+  printf("[ccs811 reads == 40 == %u, baseline reads == 2 == %u]\n",
+         ccs811.result_reads - result_reads, ccs811.baseline_reads - baseline_reads);
+  Device.set_reading(Device::READING_ECO2, 612);
+  ccs811.eco2 = 999;
+  ccs811.status = 0x90;
+  airQualitySensorComponent.sample();
+  float eco2 = 0;
+  Device.get_reading(Device::READING_ECO2, eco2);
+  printf("[ccs811 not ready: eco2 == 612 == %.0f]\n", eco2);
+  ccs811.status = 0x91;
+  ccs811.error_id = 0x04;
+  airQualitySensorComponent.sample();
+  printf("[ccs811 error: failing == 1 == %d]\n",
+         airQualitySensorComponent.m_state == AirQualitySensorComponent::STATE_FAILING);
+  // The loop() coroutine backs off, then resets and wakes it again.
+  ccs811.status = 0x98;
+  ccs811.error_id = 0;
+  unsigned long failed = millis();
+  unsigned bodies = 0;
+  while (airQualitySensorComponent.m_state != AirQualitySensorComponent::STATE_ACTIVE &&
+         millis() - failed < 60000) {
+    millis(millis() + 1);
+    bodies += airQualitySensorComponent.m_co.is_due();
+    airQualitySensorComponent.loop();
+  }
+  printf("[ccs811 recovery: active after == 30024 == %lu ms, in == 4 == %u loops]\n",
+         millis() - failed, bodies);
+
+  // DHT11: edges from the stand-in, decoded in later loop() steps;
+  // retried after a bad checksum or a glitch, given up after three
+  // silent tries.
+  Dht11Reader dhtreader(PIN_DHT11);
+  Dht11StandIn dhtsensor(55, -3.2);
+  dhtsensor.attach(dhtreader);
+  auto dht11_read = [](Dht11Reader& reader) {
+    reader.start();
+    for (int n = 0; n < 1000 && !reader.loop(); ++n) {
+      millis(millis() + 10);
+    }
+  };
+  dht11_read(dhtreader);
+  printf("[dht11 == OK 55.0 -3.2 == %s %.1f %.1f]\n",
+         reinterpret_cast<const char*>(dhtreader.get_status_string()),
+         dhtreader.get_humidity(), dhtreader.get_temperature());
+  dhtsensor.failure = Dht11StandIn::FLIP_BIT;
+  dhtsensor.failures = 1;
+  dhtsensor.responses = 0;
+  dht11_read(dhtreader);
+  printf("[dht11 checksum: tries == 2 == %u, OK == %s]\n", dhtsensor.responses,
+         reinterpret_cast<const char*>(dhtreader.get_status_string()));
+  dhtsensor.failure = Dht11StandIn::GLITCH;
+  dhtsensor.failures = 1;
+  dhtsensor.responses = 0;
+  dht11_read(dhtreader);
+  printf("[dht11 glitch: tries == 2 == %u, OK == %s]\n", dhtsensor.responses,
+         reinterpret_cast<const char*>(dhtreader.get_status_string()));
+  dhtsensor.failure = Dht11StandIn::MUTE;
+  dhtsensor.failures = 3;
+  dhtsensor.responses = 0;
+  dht11_read(dhtreader);
+  printf("[dht11 mute: TIMEOUT == %s after 3 == %u, nan == 1 == %d]\n",
+         reinterpret_cast<const char*>(dhtreader.get_status_string()),
+         dhtsensor.responses, isnan(dhtreader.get_temperature()));
+  // GPIO16 (PIN_DHT11) has no interrupt and is polled; the same on a
+  // pin with one.
+  Dht11Reader dhtirqreader(14);
+  dhtsensor.attach(dhtirqreader);
+  dht11_read(dhtirqreader);
+  printf("[dht11 polled: gpio16 == 1 == %d, gpio14 == 0 == %d, OK == %s]\n",
+         dhtreader.m_polled, dhtirqreader.m_polled,
+         reinterpret_cast<const char*>(dhtirqreader.get_status_string()));
+
+  // HUD sources: the primary first, skipped while it backs off (longer
+  // after each failure); the secondary first only when it is clearly
+  // faster, and the primary retried once that is old news.
+  HudSources sources;
+  sources.add(F("http://primary.example.com/hud.txt"));
+  sources.add(F("http://secondary.example.com/hud.txt"));
+  uint8_t order[HudSources::MAX_SOURCES];
+  uint8_t norder = sources.order(order);
+  printf("[hud sources == 2 0 == %u %u]\n", norder, order[0]);
+  sources.add_failure(0);
+  norder = sources.order(order);
+  printf("[hud primary failed == 1 1 == %u %u]\n", norder, order[0]);
+  millis(millis() + HudSources::BACKOFF_MIN);
+  norder = sources.order(order);
+  printf("[hud primary back == 2 0 == %u %u]\n", norder, order[0]);
+  sources.add_failure(0);
+  millis(millis() + HudSources::BACKOFF_MIN);
+  printf("[hud primary failed again: backed off == 1 == %d]\n", sources.is_backed_off(0));
+  millis(millis() + HudSources::BACKOFF_MIN);
+  for (int k = 0; k < 4; ++k) {
+    sources.add_success(0, 1200);
+    sources.add_success(1, 300);
+  }
+  sources.order(order);
+  printf("[hud faster secondary == 1 0 == %u %u, %lu ms]\n",
+         order[0], order[1], sources.get_latency(1));
+  millis(millis() + HudSources::LATENCY_TTL);
+  sources.add_success(1, 300);
+  sources.order(order);
+  printf("[hud primary retried == 0 == %u]\n", order[0]);
+  HudSources single;
+  single.add(F("http://primary.example.com/hud.txt"));
+  single.add_failure(0);
+  single.add_failure(0);
+  norder = single.order(order);
+  sources.add_failure(0);
+  millis(millis() + 1000);
+  sources.add_failure(1);
+  uint8_t sorder = sources.order(order);
+  printf("[hud all backed off: still polled == 1 1 == %u %u, first back == 0 == %u]\n",
+         norder, sorder, order[0]);
+
+  // No source answered: the last text stays, marked stale.
+  displayComponent.set_text("Hello", "world", Device::COLOR_YELLOW);
+  displayComponent.set_stale(true);
+  String stale0 = displayComponent.m_message0;
+  displayComponent.set_stale(false);
+  printf("[hud stale == 16 ? == %u %c, fresh == Hello == %s]\n",
+         stale0.length(), stale0[LCD_COLS - 1], displayComponent.m_message0.c_str());
+
+  // Failover through the HTTPClient: the primary fails and the secondary
+  // sends a snapshot; with all of them down the last text stays, marked
+  // stale (not "HTTP/-1"); the primary back clears the mark.
+  networkComponent.m_sources = HudSources();
+  networkComponent.m_sources.add(F(SECRET_HUD_URL));
+  networkComponent.m_sources.add(F("http://secondary.example.com/hud.txt"));
+  networkComponent.m_remotesource = NetworkComponent::NO_SOURCE;
+  HudServerStandIn primaryhud, secondaryhud;
+  primaryhud.set(HudServerStandIn::LINE0, "primary");
+  primaryhud.set(HudServerStandIn::LINE1, "-");
+  secondaryhud.set(HudServerStandIn::LINE0, "secondary");
+  HttpServer.clear();
+  HttpServers::Route& primary = primaryhud.serve(SECRET_HUD_URL);
+  HttpServers::Route& secondary = secondaryhud.serve("http://secondary.example.com/");
+  primary.ms = 40;
+  secondary.ms = 60;
+  networkComponent.sample();
+  printf("[failover primary == 0 primary == %u %s]\n",
+         networkComponent.m_remotesource, displayComponent.m_message0.c_str());
+  primary.up = false;
+  networkComponent.sample();
+  printf("[failover secondary == 1 secondary v=0 == %u %s %s]\n",
+         networkComponent.m_remotesource, displayComponent.m_message0.c_str(),
+         secondary.lasturl.substring(secondary.lasturl.indexOf("v=")).c_str());
+  secondary.up = false;
+  millis(millis() + HudSources::BACKOFF_MIN);
+  unsigned requests = primary.requests + secondary.requests;
+  networkComponent.sample();
+  printf("[failover all down: tried == 2 == %u, stale == 1 secondary ? == %d %s %c]\n",
+         primary.requests + secondary.requests - requests, networkComponent.m_remotestale,
+         displayComponent.m_message0.substring(0, 9).c_str(),
+         displayComponent.m_message0[LCD_COLS - 1]);
+  primary.up = true;
+  millis(millis() + HudSources::BACKOFF_MAX);
+  networkComponent.sample();
+  printf("[failover primary back == 0 0 primary v=0 == %u %d %s %s]\n",
+         networkComponent.m_remotesource, networkComponent.m_remotestale,
+         displayComponent.m_message0.c_str(),
+         primary.lasturl.substring(primary.lasturl.indexOf("v=")).c_str());
+  HttpServer.clear();
+
+  i2cBus.dump_stats(Serial);
+  FlightRecorder.dump(Serial);
+  printf("[flightrec == %s]\n", FlightRecorder.to_formdata().c_str());
+
   return 0;
 }
 #endif